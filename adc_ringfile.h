@@ -0,0 +1,200 @@
+// Memory-mapped binary ring file for continuous ADC capture
+//
+// The file is created at its full size up front and mapped MAP_SHARED, so
+// logging a scan is a memcpy into the page cache: no formatting and no
+// syscall per sample. When the ring is full the oldest scans are overwritten,
+// so a capture can run for hours in a fixed amount of disk.
+//
+// Layout: one ADC_RING_HEADER_SIZE header page, then 'capacity' fixed-size
+// records. A record is one scan: an int64 CLOCK_MONOTONIC timestamp in ns
+// followed by one uint16 code per channel, padded to 8 bytes. The header's
+// 'head' counts every record ever written and is stored after the record,
+// so a reader only trusts records below it; record k lives in slot k % capacity.
+//
+// Dirty pages are handed to the kernel with msync(MS_ASYNC) in batches of
+// ADC_RING_SYNC_BYTES or every ADC_RING_SYNC_NS, whichever comes first.
+// resources/adc_log_decode.c converts a ring file to CSV.
+
+#ifndef ADC_RINGFILE_H
+#define ADC_RINGFILE_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include "rt_atomic.h"
+#include "rt_timing.h"
+
+#define ADC_RING_MAGIC			"DASRING1"
+#define ADC_RING_VERSION		1
+#define ADC_RING_HEADER_SIZE	4096
+#define ADC_RING_MAX_CHANNELS	16
+#define ADC_RING_SYNC_BYTES		(1 << 20)
+#define ADC_RING_SYNC_NS		1000000000LL
+
+typedef struct {
+    char magic[8];				// ADC_RING_MAGIC
+    uint32_t version;
+    uint32_t header_size;		// offset of the first record
+    uint32_t record_size;		// bytes per record, multiple of 8
+    uint32_t channels;			// codes per record
+    uint32_t first_channel;		// ADC channel of the first code
+    uint32_t reserved;
+    uint64_t capacity;			// records in the ring
+    volatile uint64_t head;		// records written so far
+    double scan_rate;			// scans per second programmed into the card
+    int64_t start_mono_ns;		// CLOCK_MONOTONIC at creation
+    int64_t start_real_ns;		// CLOCK_REALTIME at creation, to turn timestamps into wall time
+} adc_ring_header_t;
+
+typedef struct {
+    int fd;
+    unsigned char* base;		// whole file mapping
+    size_t size;
+    adc_ring_header_t* hdr;
+    uint64_t synced;			// records already passed to msync
+    int64_t synced_ns;
+    int64_t period_ns;			// time between scans, for timestamps inside a block
+    uint16_t partial[ADC_RING_MAX_CHANNELS];	// scan split across two blocks
+    unsigned partial_n;
+    long page;
+} adc_ring_t;
+
+static inline uint32_t adc_ring_record_size(uint32_t channels) {
+    return (uint32_t)((sizeof(int64_t) + channels * sizeof(uint16_t) + 7) & ~7u);
+}
+
+static inline unsigned char* adc_ring_slot(adc_ring_t* ring, uint64_t k) {
+    return ring->base + ring->hdr->header_size + (k % ring->hdr->capacity) * ring->hdr->record_size;
+}
+
+static inline int adc_ring_open(adc_ring_t* ring, const char* path, uint32_t first_channel, uint32_t channels, double scan_rate, uint64_t capacity) {
+    // Create (or truncate) path at its final size and map it. Returns -1 on error.
+    struct timespec ts;
+    uint32_t record_size;
+
+    if (channels < 1 || channels > ADC_RING_MAX_CHANNELS || capacity < 1) {
+        fprintf(stderr, "adc_ring_open: bad geometry\n");
+        return -1;
+    }
+    memset(ring, 0, sizeof(*ring));
+    record_size = adc_ring_record_size(channels);
+    ring->size = ADC_RING_HEADER_SIZE + (size_t)capacity * record_size;
+    ring->page = sysconf(_SC_PAGESIZE);
+
+    if ((ring->fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0644)) == -1) {
+        perror("open");
+        return -1;
+    }
+    if (ftruncate(ring->fd, (off_t)ring->size) == -1) {
+        perror("ftruncate");
+        close(ring->fd);
+        return -1;
+    }
+    ring->base = mmap(NULL, ring->size, PROT_READ | PROT_WRITE, MAP_SHARED, ring->fd, 0);
+    if (ring->base == MAP_FAILED) {
+        perror("mmap");
+        close(ring->fd);
+        return -1;
+    }
+
+    ring->hdr = (adc_ring_header_t*)ring->base;
+    memcpy(ring->hdr->magic, ADC_RING_MAGIC, sizeof(ring->hdr->magic));
+    ring->hdr->version = ADC_RING_VERSION;
+    ring->hdr->header_size = ADC_RING_HEADER_SIZE;
+    ring->hdr->record_size = record_size;
+    ring->hdr->channels = channels;
+    ring->hdr->first_channel = first_channel;
+    ring->hdr->capacity = capacity;
+    ring->hdr->head = 0;
+    ring->hdr->scan_rate = scan_rate;
+    ring->hdr->start_mono_ns = rt_now_ns();
+    clock_gettime(CLOCK_REALTIME, &ts);
+    ring->hdr->start_real_ns = (int64_t)ts.tv_sec * RT_NSEC_PER_SEC + ts.tv_nsec;
+
+    ring->period_ns = (int64_t)(1e9 / scan_rate);
+    ring->synced_ns = ring->hdr->start_mono_ns;
+    msync(ring->base, ADC_RING_HEADER_SIZE, MS_ASYNC);
+    return 0;
+}
+
+static inline void adc_ring_append(adc_ring_t* ring, int64_t t_ns, const uint16_t* codes) {
+    // One scan. The record is complete before head moves past it.
+    unsigned char* rec = adc_ring_slot(ring, ring->hdr->head);
+
+    memcpy(rec, &t_ns, sizeof(t_ns));
+    memcpy(rec + sizeof(t_ns), codes, ring->hdr->channels * sizeof(uint16_t));
+    rt_store_release(&ring->hdr->head, ring->hdr->head + 1);
+}
+
+static inline void adc_ring_append_words(adc_ring_t* ring, const uint16_t* words, unsigned n, int64_t t_last_ns) {
+    // A block of FIFO words, t_last_ns being the time of its last word. Scans split
+    // across blocks are carried over; each scan is stamped back from t_last_ns by the scan period.
+    unsigned channels = ring->hdr->channels;
+    unsigned i = 0, take;
+    int64_t scans_left = (ring->partial_n + n) / channels;
+
+    if (ring->partial_n > 0) {
+        take = channels - ring->partial_n;
+        if (take > n) take = n;
+        memcpy(ring->partial + ring->partial_n, words, take * sizeof(uint16_t));
+        ring->partial_n += take;
+        i = take;
+        if (ring->partial_n < channels) return;
+        adc_ring_append(ring, t_last_ns - --scans_left * ring->period_ns, ring->partial);
+        ring->partial_n = 0;
+    }
+    for (; i + channels <= n; i += channels) {
+        adc_ring_append(ring, t_last_ns - --scans_left * ring->period_ns, words + i);
+    }
+    if (i < n) {
+        ring->partial_n = n - i;
+        memcpy(ring->partial, words + i, ring->partial_n * sizeof(uint16_t));
+    }
+}
+
+static inline void adc_ring_msync_range(adc_ring_t* ring, uint64_t from, uint64_t to) {
+    // msync records [from, to) that sit contiguously in the file, rounded out to pages
+    uintptr_t a = (uintptr_t)adc_ring_slot(ring, from);
+    uintptr_t b = a + (to - from) * ring->hdr->record_size;
+
+    a &= ~(uintptr_t)(ring->page - 1);
+    msync((void*)a, b - a, MS_ASYNC);
+}
+
+static inline void adc_ring_sync(adc_ring_t* ring, int force) {
+    // Batched flush: only when enough data or time has built up, unless forced
+    uint64_t head = ring->hdr->head;
+    uint64_t from = ring->synced, wrap;
+    int64_t now = rt_now_ns();
+
+    if (head == from) return;
+    if (!force && (head - from) * ring->hdr->record_size < ADC_RING_SYNC_BYTES && now - ring->synced_ns < ADC_RING_SYNC_NS) {
+        return;
+    }
+    if (head - from > ring->hdr->capacity) {
+        from = head - ring->hdr->capacity;		// overwritten before it was synced
+    }
+
+    // At most two contiguous runs: up to the end of the ring, then from its start
+    wrap = from + (ring->hdr->capacity - from % ring->hdr->capacity);
+    if (head > wrap) {
+        adc_ring_msync_range(ring, from, wrap);
+        from = wrap;
+    }
+    adc_ring_msync_range(ring, from, head);
+    msync(ring->base, ADC_RING_HEADER_SIZE, MS_ASYNC);
+    ring->synced = head;
+    ring->synced_ns = now;
+}
+
+static inline void adc_ring_close(adc_ring_t* ring) {
+    adc_ring_sync(ring, 1);
+    msync(ring->base, ring->size, MS_SYNC);
+    munmap(ring->base, ring->size);
+    close(ring->fd);
+}
+
+#endif
@@ -0,0 +1,202 @@
+// Asynchronous batched logging for real-time threads
+//
+// A real-time thread never formats text or makes a syscall to log. It appends
+// a fixed-size binary record to its own single-producer ring, which is a few
+// stores and one release barrier, and drops the record (counting it) if the
+// ring is full rather than wait. A background flusher thread wakes every
+// ASYNC_LOG_FLUSH_NS, drains every writer's ring, turns records into text with
+// the formatter registered for their event and write()s the result in large
+// batches.
+//
+// Each writer ring has exactly one producer (the thread that registered it)
+// and one consumer (the flusher), so no locks are needed on the hot path.
+// Writers register before their loop starts; registration is the only locked
+// operation.
+
+#ifndef ASYNC_LOG_H
+#define ASYNC_LOG_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <unistd.h>
+#include "rt_atomic.h"
+#include "rt_timing.h"
+
+#define ASYNC_LOG_RING_BITS		14
+#define ASYNC_LOG_RING_SIZE		(1u << ASYNC_LOG_RING_BITS)
+#define ASYNC_LOG_RING_MASK		(ASYNC_LOG_RING_SIZE - 1)
+#define ASYNC_LOG_MAX_WRITERS	8
+#define ASYNC_LOG_MAX_EVENTS	16
+#define ASYNC_LOG_FLUSH_NS		100000000LL		// flusher period
+#define ASYNC_LOG_BATCH			65536			// bytes of text per write()
+#define ASYNC_LOG_LINE			256				// longest formatted record
+#define ASYNC_LOG_CACHE_LINE	64
+
+typedef struct {
+    int64_t t_ns;				// CLOCK_MONOTONIC when the record was made
+    uint32_t event;				// index of the formatter
+    uint32_t a;					// event arguments, meaning up to the formatter
+    double v;
+} async_log_rec_t;
+
+// Writes rec as text into out (at most size bytes) and returns the length, like snprintf
+typedef int (*async_log_fmt_t)(char* out, size_t size, const async_log_rec_t* rec);
+
+typedef struct {
+    volatile uint32_t head;		// stored by the writer only
+    char pad0[ASYNC_LOG_CACHE_LINE - sizeof(uint32_t)];
+    volatile uint32_t tail;		// stored by the flusher only
+    char pad1[ASYNC_LOG_CACHE_LINE - sizeof(uint32_t)];
+    volatile unsigned long dropped;	// records lost to a full ring
+    const char* name;
+    async_log_rec_t rec[ASYNC_LOG_RING_SIZE];
+} async_log_writer_t;
+
+typedef struct {
+    int fd;
+    async_log_writer_t* writer[ASYNC_LOG_MAX_WRITERS];
+    volatile int writers;
+    async_log_fmt_t fmt[ASYNC_LOG_MAX_EVENTS];
+    pthread_mutex_t lock;		// registration only
+    pthread_t flusher;
+    volatile int running;
+    unsigned long records;		// records written out
+    unsigned long batches;		// write() calls
+    char batch[ASYNC_LOG_BATCH];
+    size_t used;
+} async_log_t;
+
+static inline void async_log_init(async_log_t* log) {
+    memset(log, 0, sizeof(*log));
+    log->fd = -1;
+    pthread_mutex_init(&log->lock, NULL);
+}
+
+static inline void async_log_event(async_log_t* log, unsigned event, async_log_fmt_t fmt) {
+    // Formatter for an event number; set them all up before records arrive
+    if (event < ASYNC_LOG_MAX_EVENTS) log->fmt[event] = fmt;
+}
+
+static inline async_log_writer_t* async_log_writer(async_log_t* log, const char* name) {
+    // Ring for the calling thread. Returns NULL if every slot is taken; async_log_put() then does nothing.
+    async_log_writer_t* w;
+
+    pthread_mutex_lock(&log->lock);
+    if (log->writers >= ASYNC_LOG_MAX_WRITERS || (w = calloc(1, sizeof(*w))) == NULL) {
+        pthread_mutex_unlock(&log->lock);
+        return NULL;
+    }
+    w->name = name;
+    log->writer[log->writers] = w;
+    rt_store_release(&log->writers, log->writers + 1);
+    pthread_mutex_unlock(&log->lock);
+    return w;
+}
+
+static inline void async_log_put(async_log_writer_t* w, uint32_t event, uint32_t a, double v) {
+    // Real-time side: append one record, never blocks
+    uint32_t head;
+    async_log_rec_t* rec;
+
+    if (w == NULL) return;
+    head = w->head;
+    if (head - rt_load_acquire(&w->tail) >= ASYNC_LOG_RING_SIZE) {
+        w->dropped++;
+        return;
+    }
+    rec = &w->rec[head & ASYNC_LOG_RING_MASK];
+    rec->t_ns = rt_now_ns();
+    rec->event = event;
+    rec->a = a;
+    rec->v = v;
+    rt_store_release(&w->head, head + 1);
+}
+
+static inline void async_log_write_batch(async_log_t* log) {
+    size_t done = 0;
+    ssize_t n;
+
+    while (done < log->used) {
+        if ((n = write(log->fd, log->batch + done, log->used - done)) <= 0) {
+            break;
+        }
+        done += (size_t)n;
+    }
+    log->used = 0;
+    log->batches++;
+}
+
+static inline void async_log_drain(async_log_t* log) {
+    // Flusher side: format everything queued and write it out in ASYNC_LOG_BATCH chunks
+    async_log_writer_t* w;
+    async_log_rec_t* rec;
+    uint32_t tail, head;
+    int i, writers = rt_load_acquire(&log->writers), len;
+
+    for (i = 0; i < writers; i++) {
+        w = log->writer[i];
+        head = rt_load_acquire(&w->head);
+        for (tail = w->tail; tail != head; tail++) {
+            rec = &w->rec[tail & ASYNC_LOG_RING_MASK];
+            if (rec->event < ASYNC_LOG_MAX_EVENTS && log->fmt[rec->event]) {
+                if (log->used + ASYNC_LOG_LINE > ASYNC_LOG_BATCH) {
+                    async_log_write_batch(log);
+                }
+                len = log->fmt[rec->event](log->batch + log->used, ASYNC_LOG_LINE, rec);
+                if (len > 0) log->used += (len < ASYNC_LOG_LINE) ? (size_t)len : ASYNC_LOG_LINE - 1;
+            }
+            log->records++;
+        }
+        rt_store_release(&w->tail, tail);
+    }
+    if (log->used > 0) {
+        async_log_write_batch(log);
+    }
+}
+
+static inline void* async_log_flusher(void* arg) {
+    async_log_t* log = arg;
+    int64_t next = rt_now_ns();
+
+    while (rt_load_acquire(&log->running)) {
+        next += ASYNC_LOG_FLUSH_NS;
+        rt_sleep_until_ns(next);
+        async_log_drain(log);
+    }
+    async_log_drain(log);
+    return NULL;
+}
+
+static inline int async_log_start(async_log_t* log, int fd) {
+    // Start flushing to fd. Returns -1 if the flusher thread could not be created.
+    log->fd = fd;
+    log->running = 1;
+    if (pthread_create(&log->flusher, NULL, async_log_flusher, log) != 0) {
+        log->running = 0;
+        return -1;
+    }
+    return 0;
+}
+
+static inline void async_log_stop(async_log_t* log) {
+    // Stop the flusher after a last drain; fd stays open for the caller
+    if (!log->running) {
+        async_log_drain(log);
+        return;
+    }
+    rt_store_release(&log->running, 0);
+    pthread_join(log->flusher, NULL);
+}
+
+static inline unsigned long async_log_dropped(async_log_t* log) {
+    unsigned long dropped = 0;
+    int i;
+
+    for (i = 0; i < log->writers; i++) dropped += log->writer[i]->dropped;
+    return dropped;
+}
+
+#endif
@@ -0,0 +1,306 @@
+// Arbitrary waveform playback from a memory-mapped sample file
+//
+// The file is raw samples in host byte order, either 16-bit DAC codes or
+// 32-bit float volts (0-5V, clamped). It is played either at its own sample
+// rate, e.g. a recorded sensor trace, or as one cycle of a waveform repeated
+// at a given frequency. Either way the position advances by a 32.32
+// fixed-point step per output sample, so any file rate can be played at the
+// output rate: samples are repeated or skipped, never interpolated, so a
+// recorded code comes out exactly as it was recorded.
+//
+// Files far larger than RAM (or than a 32-bit address space) are streamed:
+// only a window of AWG_MAP_BYTES is mapped at a time, and windows follow each
+// other by half a window. Making a mapping is not cheap: under
+// mlockall(MCL_FUTURE) mmap() faults in and locks the whole window before it
+// returns, which is disk reads for the half not played yet. That would take
+// far longer than the producer's lead over the output thread, so a helper
+// thread makes the mappings instead: once playback reaches the second half of
+// a window, the helper is asked to map the next one (or the first, for the
+// wrap at the end of the file) and has a half window of playing time to do
+// it. The reader only swaps pointers; old windows are unmapped by the helper
+// too. If the next window is not ready in time (the helper could not keep
+// up, or the step skips whole windows) the reader maps it itself and counts
+// a late remap. Up to three windows can be mapped, and locked, at once.
+
+#ifndef AWG_FILE_H
+#define AWG_FILE_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <pthread.h>
+#include "wave_table.h"
+
+#define AWG_MAP_BYTES		(4u << 20)		// mapped window, a power of two and a multiple of the page size
+#define AWG_MAP_HALF		(AWG_MAP_BYTES / 2)
+
+enum awg_format {
+    AWG_CODES,		// unsigned 16-bit DAC codes
+    AWG_VOLTS		// 32-bit float volts
+};
+
+typedef struct {
+    int fd;
+    int format;
+    size_t width;				// bytes per sample
+    uint64_t size;				// file size in bytes
+    uint64_t samples;			// whole samples in the file
+    double file_rate;			// samples per second to play at, 0 to play the file as one cycle
+    uint64_t pos;				// 32.32 fixed-point sample position
+    uint64_t step;				// added to pos per output sample
+    const unsigned char* map;	// current window, NULL if none
+    uint64_t map_off;			// file offset of the window
+    size_t map_len;
+    int asked;					// next window requested for the current one
+    unsigned long remaps;		// windows mapped ahead by the helper, and the first; under lock
+    unsigned long late_remaps;	// windows the reader had to map itself, the helper's not being ready
+
+    // Helper thread state, under lock. The reader holds the lock for a few loads and stores only.
+    pthread_t helper;
+    int helper_running;
+    pthread_mutex_t lock;
+    pthread_cond_t wake;
+    int quit;
+    int want;					// want_off requested and not mapped yet
+    uint64_t want_off;
+    const unsigned char* next;	// window mapped ahead, NULL if none
+    uint64_t next_off;
+    size_t next_len;
+    const unsigned char* retired[2];	// windows for the helper to unmap
+    size_t retired_len[2];
+} awg_file_t;
+
+static inline void awg_set_speed(awg_file_t* awg, float frequency, double sample_rate) {
+    // Step per output sample: the file rate if one was given, else one pass through the file per cycle of frequency
+    double step = (awg->file_rate > 0.0) ? awg->file_rate / sample_rate : frequency * (double)awg->samples / sample_rate;
+
+    awg->step = (uint64_t)(step * 4294967296.0);
+}
+
+static inline const unsigned char* awg_map_window(awg_file_t* awg, uint64_t offset, size_t* len) {
+    // Map the window starting at offset, a multiple of AWG_MAP_HALF. Returns NULL on error.
+    void* map;
+
+    *len = (awg->size - offset < AWG_MAP_BYTES) ? (size_t)(awg->size - offset) : AWG_MAP_BYTES;
+    map = mmap(NULL, *len, PROT_READ, MAP_SHARED, awg->fd, (off_t)offset);
+    if (map == MAP_FAILED) {
+        return NULL;
+    }
+    madvise(map, *len, MADV_SEQUENTIAL);
+    return map;
+}
+
+static inline void* awg_helper(void* arg) {
+    // Helper thread: map the window asked for and unmap retired ones, never holding the lock over either
+    awg_file_t* awg = arg;
+    const unsigned char* map;
+    size_t len;
+    uint64_t offset;
+    int i;
+
+    pthread_mutex_lock(&awg->lock);
+    while (!awg->quit) {
+        for (i = 0; i < 2; i++) {
+            if ((map = awg->retired[i]) != NULL) {
+                len = awg->retired_len[i];
+                awg->retired[i] = NULL;
+                pthread_mutex_unlock(&awg->lock);
+                munmap((void*)map, len);
+                pthread_mutex_lock(&awg->lock);
+            }
+        }
+        if (awg->want && awg->next == NULL) {
+            offset = awg->want_off;
+            pthread_mutex_unlock(&awg->lock);
+            map = awg_map_window(awg, offset, &len);
+            pthread_mutex_lock(&awg->lock);
+            if (map) {
+                awg->next = map;
+                awg->next_off = offset;
+                awg->next_len = len;
+                awg->remaps++;
+            }
+            awg->want = 0;
+            continue;
+        }
+        if (awg->retired[0] == NULL && awg->retired[1] == NULL) {
+            pthread_cond_wait(&awg->wake, &awg->lock);
+        }
+    }
+    pthread_mutex_unlock(&awg->lock);
+    return NULL;
+}
+
+static inline void awg_retire(awg_file_t* awg, const unsigned char* map, size_t len) {
+    // Hand a window to the helper to unmap; with the lock held
+    int i;
+
+    for (i = 0; i < 2; i++) {
+        if (awg->retired[i] == NULL) {
+            awg->retired[i] = map;
+            awg->retired_len[i] = len;
+            return;
+        }
+    }
+    munmap((void*)map, len);		// cannot happen with one window retired per move, but never leak one
+}
+
+static inline void awg_prefetch(awg_file_t* awg) {
+    // Ask the helper for the window after the current one, or the first for the wrap at the end of the file
+    uint64_t offset = (awg->map_off + awg->map_len >= awg->size) ? 0 : awg->map_off + AWG_MAP_HALF;
+
+    awg->asked = 1;
+    if (!awg->helper_running) return;
+    pthread_mutex_lock(&awg->lock);
+    if (awg->next && awg->next_off != offset) {
+        awg_retire(awg, awg->next, awg->next_len);		// finished after the reader had moved on without it
+        awg->next = NULL;
+    }
+    awg->want_off = offset;
+    awg->want = (awg->next == NULL);
+    pthread_cond_signal(&awg->wake);
+    pthread_mutex_unlock(&awg->lock);
+}
+
+static inline int awg_move(awg_file_t* awg, uint64_t byte) {
+    // Make the window holding byte current: the helper's if it holds it, else map it here
+    const unsigned char* map = NULL;
+    uint64_t offset = 0;
+    size_t len = 0;
+
+    if (awg->helper_running) {
+        pthread_mutex_lock(&awg->lock);
+        if (awg->next && byte >= awg->next_off && byte < awg->next_off + awg->next_len) {
+            map = awg->next;
+            offset = awg->next_off;
+            len = awg->next_len;
+        }
+        else if (awg->next) {
+            awg_retire(awg, awg->next, awg->next_len);		// mapped for a position playback skipped
+        }
+        awg->next = NULL;
+        awg->want = 0;
+        if (awg->map) awg_retire(awg, awg->map, awg->map_len);
+        pthread_cond_signal(&awg->wake);
+        pthread_mutex_unlock(&awg->lock);
+    }
+    else if (awg->map) {
+        munmap((void*)awg->map, awg->map_len);
+    }
+    awg->map = NULL;
+
+    if (map == NULL) {
+        offset = byte & ~(uint64_t)(AWG_MAP_HALF - 1);
+        if ((map = awg_map_window(awg, offset, &len)) == NULL) {
+            return -1;
+        }
+        awg->late_remaps++;
+    }
+    awg->map = map;
+    awg->map_off = offset;
+    awg->map_len = len;
+    awg->asked = 0;
+    return 0;
+}
+
+static inline unsigned short awg_sample(awg_file_t* awg, uint64_t index) {
+    // DAC code of one sample, moving the window if it is not in it. Returns mid-scale if the file cannot be mapped.
+    uint64_t byte = index * awg->width;
+    const unsigned char* p;
+    float volts;
+
+    if (awg->map == NULL || byte < awg->map_off || byte >= awg->map_off + awg->map_len) {
+        if (awg_move(awg, byte) == -1) {
+            return 0x8000;
+        }
+    }
+    if (!awg->asked && byte >= awg->map_off + AWG_MAP_HALF && awg->map_len < awg->size) {
+        awg_prefetch(awg);
+    }
+    p = awg->map + (byte - awg->map_off);
+    if (awg->format == AWG_VOLTS) {
+        memcpy(&volts, p, sizeof(volts));
+        return voltage_to_dac(volts);
+    }
+    return *(const uint16_t*)p;
+}
+
+static inline int awg_open(awg_file_t* awg, const char* filename, int format, double file_rate) {
+    // Open a sample file for playback. Returns -1 with errno set if it cannot be opened or holds no whole sample.
+    struct stat st;
+
+    memset(awg, 0, sizeof(*awg));
+    awg->format = format;
+    awg->width = (format == AWG_VOLTS) ? sizeof(float) : sizeof(uint16_t);
+    awg->file_rate = file_rate;
+    if ((awg->fd = open(filename, O_RDONLY)) == -1) {
+        return -1;
+    }
+    if (fstat(awg->fd, &st) == -1) {
+        close(awg->fd);
+        return -1;
+    }
+    awg->size = st.st_size;
+    awg->samples = awg->size / awg->width;
+    if (awg->samples == 0) {
+        close(awg->fd);
+        errno = EINVAL;
+        return -1;
+    }
+
+    // The first window now, before playback; the rest from the helper. Without a helper the reader maps them itself.
+    if ((awg->map = awg_map_window(awg, 0, &awg->map_len)) == NULL) {
+        close(awg->fd);
+        return -1;
+    }
+    awg->remaps = 1;
+    rt_mutex_init(&awg->lock);		// the reader is the real-time producer
+    pthread_cond_init(&awg->wake, NULL);
+    awg->helper_running = (pthread_create(&awg->helper, NULL, awg_helper, awg) == 0);
+    return 0;
+}
+
+static inline void awg_read(awg_file_t* awg, unsigned short* codes, uint32_t count) {
+    // Next count codes at the current step, wrapping round to the start of the file
+    uint64_t index;
+    uint32_t i;
+
+    for (i = 0; i < count; i++) {
+        index = awg->pos >> 32;
+        if (index >= awg->samples) {
+            index %= awg->samples;
+            awg->pos = (index << 32) | (awg->pos & 0xFFFFFFFFu);
+        }
+        codes[i] = awg_sample(awg, index);
+        awg->pos += awg->step;
+    }
+}
+
+static inline void awg_close(awg_file_t* awg) {
+    int i;
+
+    if (awg->helper_running) {
+        pthread_mutex_lock(&awg->lock);
+        awg->quit = 1;
+        pthread_cond_signal(&awg->wake);
+        pthread_mutex_unlock(&awg->lock);
+        pthread_join(awg->helper, NULL);
+        awg->helper_running = 0;
+    }
+    for (i = 0; i < 2; i++) {
+        if (awg->retired[i]) munmap((void*)awg->retired[i], awg->retired_len[i]);
+    }
+    if (awg->next) munmap((void*)awg->next, awg->next_len);
+    if (awg->map) {
+        munmap((void*)awg->map, awg->map_len);
+        awg->map = NULL;
+    }
+    close(awg->fd);
+}
+
+#endif
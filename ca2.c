@@ -5,9 +5,6 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <unistd.h>
-#include <hw/pci.h>
-#include <hw/inout.h>
-#include <sys/neutrino.h>
 #include <sys/mman.h>
 #include <math.h>
 #include <pthread.h>
@@ -17,17 +14,11 @@
 #include <time.h>
 #include <fcntl.h>
 
-// Hardware registers definition
-#define INTERRUPT   iobase[1] + 0
-#define MUXCHAN    iobase[1] + 2
-#define TRIGGER    iobase[1] + 4
-#define AUTOCAL    iobase[1] + 6
-#define DA_CTLREG  iobase[1] + 8
-#define AD_DATA    iobase[2] + 0
-#define AD_FIFOCLR iobase[2] + 2
-#define DA_Data    iobase[4] + 0
-#define DA_FIFOCLR iobase[4] + 2
-#define DIO_PORTA  iobase[3] + 4
+#include "das1602.h"
+#include "das_adc.h"
+#include "rt_timing.h"
+#include "async_log.h"
+#include "wave_simd.h"
 
 // Constants
 #define PI 3.14159265358979323846
@@ -69,6 +60,7 @@ char* equals;
 char* value;
 char* newline;
 int fd; // for file read write
+volatile sig_atomic_t terminated_by_user;	// log the exit reason once the logger has drained
 float frequency;
 int amplitude;
 int mode;   // for input mode selection
@@ -77,11 +69,14 @@ int mode;   // for input mode selection
 pthread_mutex_t mutex = PTHREAD_MUTEX_INITIALIZER;
 pthread_cond_t cond = PTHREAD_COND_INITIALIZER;
 
-// PCI device variables
-struct pci_dev_info info;
-void *hdl;
-uintptr_t iobase[6];
-int badr[5];
+// Log records are formatted and written by the logger's flusher thread, never by the real-time threads
+enum LogEvent {
+    LOG_POINT,
+    LOG_CYCLE,
+    LOG_FREQUENCY,
+    LOG_AMPLITUDE
+};
+async_log_t wave_log;
 
 // Add these global variables
 uint16_t adc_in;
@@ -105,72 +100,51 @@ void save_default_settings(void);
 
 
 void init_hardware(void) {
-    // Initialize PCI hardware
-    memset(&info, 0, sizeof(info));
-    if(pci_attach(0) < 0) {
-        perror("pci_attach");
-        exit(EXIT_FAILURE);
+    // Attach to the PCI-DAS1602, map its registers and get I/O privileges
+    das_attach(0);
+}
+
+// One generator per waveform type, each filling one cycle of the shape (-1 to 1)
+// from its own formula, so the point loop has no switch on the type. Formulas
+// see the point index i. Sine and cardiac are filled a SIMD block at a time by
+// wave_simd.h.
+#define WAVE_KERNEL(name, EXPR)														\
+    void generate_##name(float* shape) {											\
+        int i;																		\
+        for (i = 0; i < POINTS_PER_CYCLE; i++) {									\
+            shape[i] = (float)(EXPR);												\
+        }																			\
     }
 
-    // Set Vendor and Device ID
-    info.VendorId = 0x1307;
-    info.DeviceId = 0x01;
+void generate_sine(float* shape) {
+    simd_sine(shape, POINTS_PER_CYCLE, 0.0f, 1.0f / POINTS_PER_CYCLE);
+}
 
-    if ((hdl = pci_attach_device(0, PCI_SHARE|PCI_INIT_ALL, 0, &info)) == 0) {
-        perror("pci_attach_device");
-        exit(EXIT_FAILURE);
-    }
-    
-    // Map I/O base address
+WAVE_KERNEL(square, (i < POINTS_PER_CYCLE / 2) ? 1.0 : -1.0)
+WAVE_KERNEL(triangle, 2.0 * fabs(i * (2.0 / POINTS_PER_CYCLE) - 1.0) - 1.0)
+WAVE_KERNEL(sawtooth, 2.0 * ((double)i / (double)(POINTS_PER_CYCLE - 1)) - 1.0)
+WAVE_KERNEL(pulse, (i < POINTS_PER_CYCLE * PULSE_WIDTH_RATIO) ? 1.0 : 0.0)
 
-    for(i = 0; i < 5; i++) {
-        badr[i] = PCI_IO_ADDR(info.CpuBaseAddress[i]);
-        iobase[i] = mmap_device_io(0x0f, badr[i]);
-    }
-    
-    // Set thread control privileges
-    if(ThreadCtl(_NTO_TCTL_IO, 0) == -1) {
-        perror("Thread Control");
-        exit(1);
-    }
+void generate_cardiac(float* shape) {
+    simd_cardiac(shape, POINTS_PER_CYCLE);
 }
 
+WAVE_KERNEL(nothing, 1)
+
+// Indexed by enum WaveformType
+void (*const wave_generators[])(float*) = {
+    generate_sine, generate_square, generate_triangle, generate_sawtooth, generate_pulse, generate_cardiac, generate_nothing
+};
+
 void generate_waveform(void) {
-    float delta = (2.0 * PI) / POINTS_PER_CYCLE;
-    float value;
+    float shape[POINTS_PER_CYCLE];
+    int i;
 
     pthread_mutex_lock(&mutex);
-    
-    for(i = 0; i < POINTS_PER_CYCLE; i++) {
-        switch(state.type) {
-            case SINE:
-                value = sin(i * delta);
-                break;
-            case SQUARE:
-                value = (i < POINTS_PER_CYCLE/2) ? 1.0 : -1.0;
-                break;
-            case TRIANGLE:
-                value = (2.0 * fabs(i * (2.0/POINTS_PER_CYCLE) - 1.0) - 1.0);
-                break;
-        	case SAWTOOTH:
-                value = (2.0 *((double) i / (double) (POINTS_PER_CYCLE -1)) -1.0);
-                break;
-           	case PULSE:
-                value = (i < POINTS_PER_CYCLE * PULSE_WIDTH_RATIO) ? 1.0 : 0.0;
-                break;
-           	case CARDIAC:
-                t =  (double) i / POINTS_PER_CYCLE;
-                value = exp(-200.0 * pow(t-0.2, 2)) - 0.1 * exp(-50.0 * pow(t - 0.35, 2)) + 0.05 * exp(-300.0 * pow(t-0.75, 2));
-                break;
-            case NOTHING:
-                value = 1;
-                break;
-        }
-        
-        // Scale value to DAC range and apply amplitude
-        state.data[i] = (unsigned int)((value + 1.0) * 0x7fff * state.amplitude / 100);
+    wave_generators[state.type](shape);
+    for (i = 0; i < POINTS_PER_CYCLE; i++) {
+        state.data[i] = (unsigned int)((shape[i] + 1.0) * 0x7fff * state.amplitude / 100);
     }
-    
     pthread_mutex_unlock(&mutex);
 }
 
@@ -196,6 +170,28 @@ void write_file(void) {
     write(fd, buffer, len);
     len = sprintf(buffer, "Amplitude: %d%%\n\n", state.amplitude);
     write(fd, buffer, len);
+
+    // From here on the waveform and analog threads only queue binary records
+    if (async_log_start(&wave_log, fd) == -1) {
+        perror("Cannot start log thread");
+        exit(1);
+    }
+}
+
+int log_point(char* out, size_t size, const async_log_rec_t* rec) {
+    return snprintf(out, size, "Point %u: Value = 0x%04X\n", rec->a, (unsigned)rec->v);
+}
+
+int log_cycle(char* out, size_t size, const async_log_rec_t* rec) {
+    return snprintf(out, size, "Cycle %u complete\n", rec->a);
+}
+
+int log_frequency(char* out, size_t size, const async_log_rec_t* rec) {
+    return snprintf(out, size, "Frequency updated: %.2f Hz\n", rec->v);
+}
+
+int log_amplitude(char* out, size_t size, const async_log_rec_t* rec) {
+    return snprintf(out, size, "Amplitude updated: %d%%\n", (int)rec->a);
 }
 
 // Settings file functions
@@ -425,16 +421,20 @@ void* input_thread(void* arg) {
 
 // Modify waveform_thread to use potentiometer values
 void* waveform_thread(void* arg) {
-    struct timespec start, now;
-    double period_ns;
+    rt_deadline_t deadline;
     int point_index = 0;
+    unsigned int cycles = 0;
     char buffer[256];
     int len;
     float current_freq;
     unsigned short output_value;
+    async_log_writer_t* log = async_log_writer(&wave_log, "waveform");
 
     generate_waveform();
     write_file();
+
+    // Sleep to an absolute deadline and only spin for the last 50 us
+    rt_deadline_start(&deadline, state.frequency * POINTS_PER_CYCLE, 50000, RT_LATE_CATCHUP);
     
     while(state.running) {
         pthread_mutex_lock(&mutex);
@@ -442,36 +442,41 @@ void* waveform_thread(void* arg) {
         output_value = (unsigned short)state.data[point_index];
         pthread_mutex_unlock(&mutex);
 
-        // Calculate period for current frequency
-        period_ns = (1000000000.0 / (current_freq * POINTS_PER_CYCLE));
+        // Period for the current frequency, from the next deadline on
+        rt_deadline_set_rate(&deadline, current_freq * POINTS_PER_CYCLE);
 
         // Output to DAC
-        out16(DA_CTLREG, 0x0a23);
-        out16(DA_FIFOCLR, 0);
-        out16(DA_Data, output_value);
+        if (das_out16_shadow(DAS_SHADOW_DA_CTL, DA_CTLREG, DAC_CTL_SW_CH0)) {
+            das_out16(DA_FIFOCLR, 0);
+        }
+        das_out16(DA_Data, output_value);
 
         // Log output
-        len = sprintf(buffer, "Point %d: Value = 0x%04X\n", 
-                     point_index, output_value);
-        write(fd, buffer, len);
+        async_log_put(log, LOG_POINT, point_index, output_value);
 
         // Move to next point
         point_index = (point_index + 1) % POINTS_PER_CYCLE;
 
-        // Beep on cycle completion
+        // Beep on cycle completion: one unbuffered byte, no stdio
         if (point_index == 0) {
-            printf("\a");
-            fflush(stdout);
+            write(STDOUT_FILENO, "\a", 1);
+            async_log_put(log, LOG_CYCLE, ++cycles, 0);
         }
 
         // Precise timing control
-        clock_gettime(CLOCK_MONOTONIC, &start);
-        do {
-            clock_gettime(CLOCK_MONOTONIC, &now);
-        } while ((now.tv_sec - start.tv_sec) * 1000000000 + 
-                 (now.tv_nsec - start.tv_nsec) < period_ns);
+        rt_deadline_wait(&deadline);
     }
 
+    // Drain what is still queued before the file is closed
+    async_log_stop(&wave_log);
+    if (terminated_by_user) {
+        len = sprintf(buffer, "\nProgram terminated by user\n");
+        write(fd, buffer, len);
+    }
+    if (async_log_dropped(&wave_log) > 0) {
+        len = sprintf(buffer, "%lu log records dropped\n", async_log_dropped(&wave_log));
+        write(fd, buffer, len);
+    }
     close(fd);
     return NULL;
 }
@@ -486,12 +491,8 @@ void signal_handler(int sig) {
         save_default_settings();
         printf("Saved current settings as default\n");
 
-        if (fd > 0) {
-            char buffer[256];
-            int len = sprintf(buffer, "\nProgram terminated by user\n");
-            write(fd, buffer, len);
-            close(fd);
-        }
+        // The waveform thread writes this to the log and closes it after the last flush
+        terminated_by_user = 1;
         pthread_mutex_unlock(&mutex);
         usleep(1000);
         signal(SIGINT, SIG_DFL);
@@ -515,49 +516,45 @@ void print_usage(char* program_name) {
 
 // New function to read analog inputs
 void* analog_input_thread(void* arg) {
-    int write_len;
-    char log_buffer[256];
     double scaled_freq;
     double scaled_amp;
+    async_log_writer_t* log = async_log_writer(&wave_log, "analog");
 
-    /* ADC initialization sequence */
-    out16(INTERRUPT, 0x60c0);
-    out16(TRIGGER, 0x2081);
-    out16(AUTOCAL, 0x007f);
-    out16(AD_FIFOCLR, 0);
-    out16(MUXCHAN, 0x0D00);
+    das_adc_t adc;
+
+    /* ADC initialization sequence, end-of-conversion interrupt attached to this thread */
+    das_adc_open(&adc, 1);
 
     printf("\nStarting analog input monitoring...\n");
     
     count = 0;
     while(state.running) {
-        pthread_mutex_lock(&mutex);
-        
-        chan = ((count & 0x0f) << 4) | (0x0f & count);
-        out16(MUXCHAN, 0x0D00 | chan);
-        delay(1);
-        out16(AD_DATA, 0);
-        
-        while(!(in16(MUXCHAN) & 0x4000));
-        adc_in = in16(AD_DATA);
+        // The conversion waits up to 10 ms on the interrupt: do it outside the lock the
+        // waveform thread takes every sample, and lock only to publish the result
+        if (das_adc_read(&adc, count, &adc_in) == -1) {
+            count = (count + 1) % 2;
+            continue;
+        }
 
         if(count == 0) {  // Frequency control
             // Scale ADC value to frequency range (1-1000 Hz)
             scaled_freq = MIN_FREQ + ((double)adc_in / 65535.0) * (MAX_FREQ - MIN_FREQ);
+            pthread_mutex_lock(&mutex);
             state.frequency = scaled_freq;  // Directly update state frequency
-            
-            write_len = sprintf(log_buffer, "Frequency updated: %.2f Hz\n", scaled_freq);
-            write(fd, log_buffer, write_len);
+            pthread_mutex_unlock(&mutex);
+
+            async_log_put(log, LOG_FREQUENCY, 0, scaled_freq);
         }
         else if(count == 1) {  // Amplitude control
             // Scale ADC value to amplitude range (0-100%)
             scaled_amp = ((double)adc_in / 65535.0) * 100;
+            pthread_mutex_lock(&mutex);
             state.amplitude = (int)scaled_amp;  // Directly update state amplitude
-            
-            write_len = sprintf(log_buffer, "Amplitude updated: %d%%\n", state.amplitude);
-            write(fd, log_buffer, write_len);
-            
-            // Regenerate waveform with new amplitude
+            pthread_mutex_unlock(&mutex);
+
+            async_log_put(log, LOG_AMPLITUDE, (int)scaled_amp, scaled_amp);
+
+            // Regenerate waveform with new amplitude (takes the lock itself)
             generate_waveform();
         }
 
@@ -567,10 +564,9 @@ void* analog_input_thread(void* arg) {
 
         count = (count + 1) % 2;
         delay(1);  // Small delay between readings
-
-        pthread_mutex_unlock(&mutex);
     }
 
+    das_adc_close(&adc);
     printf("Analog input monitoring stopped\n");
     return NULL;
 }
@@ -671,6 +667,13 @@ int main(int argc, char* argv[]) {
     state.data = malloc(POINTS_PER_CYCLE * sizeof(unsigned int));
     pthread_mutex_init(&mutex, NULL);
 
+    // Logger and its formatters are ready before any thread can queue a record
+    async_log_init(&wave_log);
+    async_log_event(&wave_log, LOG_POINT, log_point);
+    async_log_event(&wave_log, LOG_CYCLE, log_cycle);
+    async_log_event(&wave_log, LOG_FREQUENCY, log_frequency);
+    async_log_event(&wave_log, LOG_AMPLITUDE, log_amplitude);
+
     // Try to load default settings
     if(access("default.txt", F_OK) != -1) {
         printf("Loading default settings...\n");
@@ -810,7 +813,7 @@ int main(int argc, char* argv[]) {
     // Cleanup
     pthread_mutex_destroy(&mutex);
     free(state.data);
-    pci_detach_device(hdl);
+    das_detach();
     printf("End of Program");
     
     return 0;
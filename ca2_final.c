@@ -1,62 +1,97 @@
+#if !defined(__QNX__)
+    #define _GNU_SOURCE		// cpu_set_t for CPU pinning in the Linux simulation build
+#endif
 
 #include <stdio.h>
 #include <stdlib.h>
 #include <unistd.h>
 #include <pthread.h>
-#include <hw/pci.h>
-#include <hw/inout.h>
-#include <sys/neutrino.h>
+#include <sched.h>
 #include <sys/mman.h>
 #include <math.h>
 #include <termios.h>
 #include <fcntl.h>
 #include <sys/select.h>
 #include <string.h>
+#include <strings.h>
 #include <signal.h>
-#include <sys/mman.h>
-
-#define	INTERRUPT	iobase[1] + 0		// Badr1 + 0 : also ADC register
-#define	MUXCHAN		iobase[1] + 2		// Badr1 + 2
-#define	TRIGGER		iobase[1] + 4		// Badr1 + 4
-#define	AUTOCAL		iobase[1] + 6		// Badr1 + 6
-#define DA_CTLREG	iobase[1] + 8		// Badr1 + 8
-
-#define	 AD_DATA	iobase[2] + 0		// Badr2 + 0
-#define	 AD_FIFOCLR	iobase[2] + 2		// Badr2 + 2
-
-#define	TIMER0		iobase[3] + 0		// Badr3 + 0
-#define	TIMER1		iobase[3] + 1		// Badr3 + 1
-#define	TIMER2		iobase[3] + 2		// Badr3 + 2
-#define	COUNTCTL	iobase[3] + 3		// Badr3 + 3
-#define	DIO_PORTA	iobase[3] + 4		// Badr3 + 4
-#define	DIO_PORTB	iobase[3] + 5		// Badr3 + 5
-#define	DIO_PORTC	iobase[3] + 6		// Badr3 + 6
-#define	DIO_CTLREG	iobase[3] + 7		// Badr3 + 7
-#define	PACER1		iobase[3] + 8		// Badr3 + 8
-#define	PACER2		iobase[3] + 9		// Badr3 + 9
-#define	PACER3		iobase[3] + a		// Badr3 + a
-#define	PACERCTL	iobase[3] + b		// Badr3 + b
-
-#define DA_Data		iobase[4] + 0		// Badr4 + 0
-#define	DA_FIFOCLR	iobase[4] + 2		// Badr4 + 2
-
-#define NUM_POINTS 100
-#define PI 3.14159
-
-#define SINE 0
-#define SQUARE 1
-#define TRIANGLE 2
-#define SAWTOOTH 3
-const char* wave_names[] = { "Sine", "Square", "Triangle", "Sawtooth"};
+#include <ctype.h>
+
+#include "das1602.h"
+#include "das_adc.h"
+#include "dds.h"
+#include "wave_table.h"
+#include "spsc_ring.h"
+#include "rt_timing.h"
+#include "params.h"
+#include "cyclic_exec.h"
+#include "rt_thread.h"
+#include "jitter_hist.h"
+#include "metrics_shm.h"
+#include "awg_file.h"
+#include "sweep.h"
+#include "modulation.h"
+
+#define PACER_SAMPLE_RATE	50000.0		// DA scans per second used for DDS output
+
+#define SW_SAMPLE_RATE 1000.0	// software-paced samples per second (100 per cycle at 10 Hz)
+
+#define PRODUCER_BLOCK 32		// codes rendered per push into the sample ring
+#define PRODUCER_LEAD 0.05		// seconds of output the producer keeps queued ahead
+
+#define SPIN_WINDOW_US 50		// default busy-wait window before each output deadline
+
+#define POT_CHAN_AMPLITUDE 0	// potentiometer ADC channels, scanned together in burst mode
+#define POT_CHAN_FREQUENCY 1
+#define POT_SCAN_RATE 500.0		// potentiometer scans per second
+#define POT_DEADBAND 64			// ADC codes (0.1% of the travel) a pot must move before the waveform is re-rendered
+
+#define CYCLIC_ADC_FRAMES 10		// cyclic executive: potentiometer scan every 10 sample frames
+#define CYCLIC_DIO_FRAMES 20		// toggle switches every 20 frames, half a period after the ADC
+#define CYCLIC_DAC_BUDGET_NS 20000LL	// longest each task may run per frame
+#define CYCLIC_ADC_BUDGET_NS 200000LL
+#define CYCLIC_DIO_BUDGET_NS 100000LL
+
+#define OUTPUT_PRIORITY 30		// output thread: pops codes and writes the DAC
+#define PRODUCER_PRIORITY 20	// producer thread: renders codes into the sample ring
+#define CONTROL_PRIORITY 12		// potentiometer and toggle switch polling
+#if defined(__QNX__)
+    #define UI_POLICY SCHED_RR	// keyboard thread: the QNX default, round robin at 10
+    #define UI_PRIORITY 10
+#else
+    #define UI_POLICY SCHED_OTHER
+    #define UI_PRIORITY 0
+#endif
+
+#define METRICS_PERIOD_US 100000	// shared-memory metrics refresh
+#define STATUS_PERIOD_US 50000		// status line redrawn at most 20 times a second
+#define STATUS_FIELDS 3				// frequency, amplitude, mean
+
+#define RT_THREAD_FILE "rt_threads.conf"	// per-thread scheduling overrides, read if present
+
+#define SINE DDS_SINE
+#define SQUARE DDS_SQUARE
+#define TRIANGLE DDS_TRIANGLE
+#define SAWTOOTH DDS_SAWTOOTH
+#define PULSE DDS_PULSE
+#define CARDIAC DDS_CARDIAC
+#define ARBITRARY DDS_WAVE_COUNT	// played from the -a sample file, not from a DDS table
+const char* wave_names[] = { "Sine", "Square", "Triangle", "Sawtooth", "Pulse", "Cardiac", "Arbitrary"};
+const char* wave_set_notes[] = {
+    "\n[INFO] Waveform type set to Sine \n", "\n[INFO] Waveform type set to Square \n", "\n[INFO] Waveform type set to Triangle \n",
+    "\n[INFO] Waveform type set to Sawtooth \n", "\n[INFO] Waveform type set to Pulse \n", "\n[INFO] Waveform type set to Cardiac \n",
+    "\n[INFO] Waveform type set to Arbitrary \n"
+};
+
+#define OUTPUT_SOFTWARE 0	// one sample per loop, paced in software
+#define OUTPUT_PACER 1		// samples clocked out of the DA FIFO by the on-board pacer
 
 #define SETTING_FILE "settings.txt"
 int empty_file = 0;
 
 // Global Variables
 volatile sig_atomic_t stop_flag = 0;
-uintptr_t iobase[6];
-int badr[5];
-void *hdl;
+volatile sig_atomic_t kill_switch = 0;	// set by the kill switch, main offers to save once the threads are down
 
 
 // Setting min and max values for amplitude, frequency and mean
@@ -65,6 +100,7 @@ const float AMPLITUDE_MIN = 0.1;
 const float AMPLITUDE_MAX = 2.5;
 const float FREQUENCY_MIN = 0.1;
 const float FREQUENCY_MAX = 10.0;
+const float PACER_FREQUENCY_MAX = 1000.0;
 const float MEAN_MIN = 0.1;
 const float MEAN_MAX = 2.5;
 
@@ -74,34 +110,132 @@ const float DEFAULT_AMPLITUDE = 2.5;
 const float DEFAULT_FREQUENCY = 10.0;
 const float DEFAULT_MEAN = 2.5;
 
-// Global variables for waveform type, amplitude, frequency and mean, changed by the user
-volatile int wave_type = SINE;
-volatile float amplitude = 2.5;
-volatile float frequency = 10.0;
-volatile float mean = 2.5;
+// Waveform type, amplitude, frequency and mean, changed by the user and read as one consistent snapshot
+params_t params;
 
 volatile int control_mode = 0; // 0 = keyboard, 1 = potentiometer
-volatile int change_waveform = 0;
-
-// Mutex for controlling access to shared variables
-pthread_mutex_t control_mutex = PTHREAD_MUTEX_INITIALIZER;
+int output_mode = OUTPUT_SOFTWARE;
+float frequency_limit = 10.0;	// FREQUENCY_MAX, or PACER_FREQUENCY_MAX in pacer mode
+int spin_window_us = SPIN_WINDOW_US;
+int late_policy = RT_LATE_CATCHUP;
+int timer_driven = 0;		// software output woken by a periodic timer pulse instead of a deadline sleep
+int cyclic = 0;				// DAC, ADC and DIO work run by one cyclic executive thread
+cyclic_exec_t executive;
+rt_deadline_t output_deadline;
+rt_ticker_t output_ticker;
+
+// Code tables played by the output thread, republished whenever a setting changes
+wave_tables_t tables;
+
+// Arbitrary waveform file (-a file[@rate]), played by the producer when the type is ARBITRARY
+char* awg_filename = NULL;
+double awg_rate = 0.0;		// file sample rate, 0 to play the file as one cycle at the set frequency
+awg_file_t awg;
+
+// Frequency/amplitude sweep (-w lin|log:f0:f1:seconds[:a0:a1][:once]), run by the producer thread
+char* sweep_spec = NULL;
+sweep_t sweep;
+volatile int sweep_on = 0;		// the sweep sets frequency and amplitude; only the producer changes it
+volatile int sweep_toggle = 0;	// 'w' pressed: stop the sweep, or start it over
+
+// Modulation of the set waveform (-m am|fm|pm:modulator:depth:rate), run by the producer thread
+char* mod_spec = NULL;
+mod_t modulation;
+volatile int mod_on = 0;		// toggled with 'o'
+
+// DAC #1 (-d wave:frequency:amplitude:mean:phase), else it mirrors DAC #0
+char* channel1_spec = NULL;
+wave_table_t channel1_table;
+dds_t channel1_dds;				// free-running DAC #1
+uint32_t channel1_offset;		// phase ahead of DAC #0, 2^32 = one cycle
+
+// Block renderers, picked by the producer whenever the mode changes so that no sample loop branches on it.
+// DAC #0 renderers fill PRODUCER_BLOCK codes and the phase of each; DAC #1 renderers pair them up into frames.
+typedef struct {
+    wave_table_t* table;		// DAC #0 table being played
+    dds_t dds;					// DAC #0 phase accumulator
+} producer_t;
+typedef void (*render_fn)(producer_t*, unsigned short*, uint32_t*);
+typedef void (*channel1_fn)(dac_frame_t*, const unsigned short*, const uint32_t*);
+
+// Ready-to-write DAC frames, rendered ahead by the producer and popped by the output thread
+spsc_ring_t sample_ring;
+volatile unsigned long underruns = 0;
+unsigned long samples_written = 0;	// samples sent to the DAC, for bus traffic per sample
+jitter_hist_t output_jitter;		// when each software-paced sample actually went out
+uint64_t skew_cycles_total = 0;		// span of the #0 and #1 data writes of each software-paced sample
+uint64_t skew_cycles_max = 0;
+volatile unsigned char dio_state;	// last toggle switch reading
+metrics_t* metrics;					// shared-memory metrics, NULL if unavailable
+
+// Status line: the status thread is the only one that draws it; other threads post to it
+volatile int status_dirty = 1;		// redraw the whole line, other output has moved the cursor
+volatile int status_adjusted = 0;	// a value was clamped to stay within the DAC range
+const char* volatile status_note = NULL;	// one-off message to print above the line
+
+// Potentiometer ADC, opened by the potentiometer thread or the cyclic executive, whichever reads it
+das_adc_t pot_adc;
+volatile uint64_t pot_posted = 0;	// POT_POSTED | amplitude code << 16 | frequency code, 0 when nothing is waiting
+#define POT_POSTED (1ULL << 32)
 
 // Thread initialization
-pthread_t wave_thread, pot_thread, kbd_thread, toggle_thread;
+pthread_t wave_thread, producer_thread, pot_thread, kbd_thread, toggle_thread, metrics_tid, status_tid;
+
+// Scheduling of every thread: policy, priority, CPU (-1 for any), stack size (0 for the default)
+enum { THREAD_OUTPUT, THREAD_PRODUCER, THREAD_POT, THREAD_TOGGLE, THREAD_KEYBOARD, THREAD_METRICS, THREAD_STATUS, THREAD_COUNT };
+rt_thread_attr_t thread_attr[THREAD_COUNT] = {
+    { "output",   SCHED_FIFO, OUTPUT_PRIORITY,   -1, 0 },
+    { "producer", SCHED_FIFO, PRODUCER_PRIORITY, -1, 0 },
+    { "pot",      SCHED_FIFO, CONTROL_PRIORITY,  -1, 0 },
+    { "toggle",   SCHED_FIFO, CONTROL_PRIORITY,  -1, 0 },
+    { "keyboard", UI_POLICY,  UI_PRIORITY,       -1, 0 },
+    { "metrics",  UI_POLICY,  UI_PRIORITY,       -1, 0 },
+    { "status",   UI_POLICY,  UI_PRIORITY,       -1, 0 },
+};
+char* thread_file = NULL;	// -r file, else RT_THREAD_FILE if it exists
 
 // Function prototypes
 void sigint_handler(int);
+void save_prompt();
 void init_pci_das1602();
-void write_to_dac(unsigned short);
+void write_to_dac(dac_frame_t);
+void publish_waveform();
+void set_wave_type(int);
+void* status_thread(void*);
+double pacer_rate(double);
+double pacer_set_rate(double);
+void pacer_stop();
+int sweep_setup(const char*, const wave_params_t*, double);
+int mod_parse(const char*, double);
+int channel1_setup(const char*, double);
+void render_table(producer_t*, unsigned short*, uint32_t*);
+void render_sweep(producer_t*, unsigned short*, uint32_t*);
+void render_modulated(producer_t*, unsigned short*, uint32_t*);
+void render_arbitrary(producer_t*, unsigned short*, uint32_t*);
+void channel1_copy(dac_frame_t*, const unsigned short*, const uint32_t*);
+void channel1_locked(dac_frame_t*, const unsigned short*, const uint32_t*);
+void channel1_free(dac_frame_t*, const unsigned short*, const uint32_t*);
+void* sample_producer_thread(void*);
 void* waveform_thread(void*);
+void* pacer_waveform_thread(void*);
 void* potentiometer_thread(void*);
 void* kbd_control(void*);
 void* toggle_switch_thread(void*);
+void* cyclic_thread(void*);
+void* metrics_thread(void*);
+void metrics_update();
+void output_task(void*);
+void pot_task(void*);
+void pot_apply();
+void toggle_task(void*);
 
+// DAC #1 renderer, replaced by -d
+channel1_fn channel1_render = channel1_copy;
 
 
-void read_settings(char* filename, volatile float* amplitude, volatile float* frequency, volatile float* mean) {
-    ///* Read settings from a file and update the global variables accordingly.
+
+void read_settings(char* filename, wave_params_t* p) {
+    ///* Read settings from a file into p.
     // If the file is empty or the values are invalid, use default values.
 	char *waveform = "sine";
     char buffer[256];
@@ -128,20 +262,34 @@ void read_settings(char* filename, volatile float* amplitude, volatile float* fr
             strlwr(waveform);
            
             if (!strcmp(waveform, "sine")) {
-                wave_type = SINE;
+                p->wave_type = SINE;
             }
             else if (!strcmp(waveform, "square")) {
-                wave_type = SQUARE;
+                p->wave_type = SQUARE;
             }
             else if (!strcmp(waveform, "triangle")) {
-                wave_type = TRIANGLE;
+                p->wave_type = TRIANGLE;
             }
             else if (!strcmp(waveform, "sawtooth")) {
-                wave_type = SAWTOOTH;
+                p->wave_type = SAWTOOTH;
+            }
+            else if (!strcmp(waveform, "pulse")) {
+                p->wave_type = PULSE;
+            }
+            else if (!strcmp(waveform, "cardiac")) {
+                p->wave_type = CARDIAC;
+            }
+            else if (!strcmp(waveform, "arbitrary") && awg_filename) {
+                p->wave_type = ARBITRARY;
+            }
+            else if (!strcmp(waveform, "arbitrary")) {
+                printf("[ERROR] The waveform saved plays a sample file: give it with -a. Continuing with default values\n");
+                p->wave_type = DEFAULT_WAVE_TYPE;
+                empty_file = 1;
             }
             else {
             	printf("[ERROR] The waveform saved is invalid. Continuing with default values\n");
-            	wave_type = DEFAULT_WAVE_TYPE;
+            	p->wave_type = DEFAULT_WAVE_TYPE;
             	empty_file = 1;
             }
         }
@@ -149,28 +297,28 @@ void read_settings(char* filename, volatile float* amplitude, volatile float* fr
         // Convert the strings to a float and check if it's within the valid range
         // If not, set it to the default value
         else if (counter == 1) {
-            *amplitude = strtof(buffer, NULL);
-            if (*amplitude < AMPLITUDE_MIN || *amplitude > AMPLITUDE_MAX) {
+            p->amplitude = strtof(buffer, NULL);
+            if (p->amplitude < AMPLITUDE_MIN || p->amplitude > AMPLITUDE_MAX) {
                 printf("[ERROR] The amplitude saved is invalid. Continuing with default values\n");
-                *amplitude = DEFAULT_AMPLITUDE;
+                p->amplitude = DEFAULT_AMPLITUDE;
                 empty_file = 1;
             }
         }
         
         else if (counter == 2) {
-            *frequency = strtof(buffer, NULL);
-            if (*frequency < FREQUENCY_MIN || *frequency > FREQUENCY_MAX) {
+            p->frequency = strtof(buffer, NULL);
+            if (p->frequency < FREQUENCY_MIN || p->frequency > frequency_limit) {
                 printf("[ERROR] The frequency saved is invalid. Continuing with default values\n");
-                *frequency = DEFAULT_FREQUENCY;
+                p->frequency = DEFAULT_FREQUENCY;
                 empty_file = 1;
             }
         }
         
         else if (counter == 3) {
-            *mean = strtof(buffer, NULL);
-            if (*mean < MEAN_MIN || *mean > MEAN_MAX || amplitude > mean) {
+            p->mean = strtof(buffer, NULL);
+            if (p->mean < MEAN_MIN || p->mean > MEAN_MAX || p->amplitude > p->mean) {
                 printf("[ERROR] The mean saved is invalid. Continuing with default values\n");
-                *mean = DEFAULT_MEAN;
+                p->mean = DEFAULT_MEAN;
                 empty_file = 1;
             }
         }
@@ -186,27 +334,27 @@ void read_settings(char* filename, volatile float* amplitude, volatile float* fr
     
 	if (empty_file) {
 		printf("[INFO] Using Default Values:\n");
-		printf("[INFO] Waveform: %s\n", wave_names[wave_type]);
-		printf("[INFO] Frequency: %.2f\n", frequency);
-		printf("[INFO] Amplitude: %.2f\n", amplitude);
-		printf("[INFO] Mean: %.2f\n\n", mean);
+		printf("[INFO] Waveform: %s\n", wave_names[p->wave_type]);
+		printf("[INFO] Frequency: %.2f\n", p->frequency);
+		printf("[INFO] Amplitude: %.2f\n", p->amplitude);
+		printf("[INFO] Mean: %.2f\n\n", p->mean);
 	}
 	else {
 		printf("[INFO] Using Saved Values:\n");
-		printf("[INFO] Waveform: %s\n", wave_names[wave_type]);
-	    	printf("[INFO] Frequency: %.2f\n", frequency);
-		printf("[INFO] Amplitude: %.2f\n", amplitude);
-		printf("[INFO] Mean: %.2f\n\n", mean);
+		printf("[INFO] Waveform: %s\n", wave_names[p->wave_type]);
+	    	printf("[INFO] Frequency: %.2f\n", p->frequency);
+		printf("[INFO] Amplitude: %.2f\n", p->amplitude);
+		printf("[INFO] Mean: %.2f\n\n", p->mean);
 	}
     
     delay(500);
 }
 
-void save_settings(char* filename, float amplitude, float frequency, float mean) {
-    ///* Save the current settings to a file. The file will be overwritten if it already exists. */
+void save_settings(char* filename, const wave_params_t* p) {
+    ///* Save the given settings to a file. The file will be overwritten if it already exists. */
     // The settings are saved in the following order: waveform, amplitude, frequency, mean
 
-    char *waveform = strdup(wave_names[wave_type]);
+    char *waveform = strdup(wave_names[p->wave_type]);
     
     FILE *file = fopen(filename, "w+");
     if (file == NULL) {
@@ -217,31 +365,38 @@ void save_settings(char* filename, float amplitude, float frequency, float mean)
     strlwr(waveform);
     
     fprintf(file, "%s\n", waveform);
-    fprintf(file, "%f\n", amplitude);
-    fprintf(file, "%f\n", frequency);
-	fprintf(file, "%f\n", mean);
+    fprintf(file, "%f\n", p->amplitude);
+    fprintf(file, "%f\n", p->frequency);
+	fprintf(file, "%f\n", p->mean);
     fclose(file);
     
     printf("\033[2J\033[H");
     printf("[INFO] Saving Values:\n");
     printf("[INFO] Waveform: %s\n", waveform);
-    printf("[INFO] Frequency: %.2f\n", frequency);
-    printf("[INFO] Amplitude: %.2f\n", amplitude);
-    printf("[INFO] Mean: %.2f\n", mean);
+    printf("[INFO] Frequency: %.2f\n", p->frequency);
+    printf("[INFO] Amplitude: %.2f\n", p->amplitude);
+    printf("[INFO] Mean: %.2f\n", p->mean);
 }
 
 void sigint_handler(int sig) {
-    ///* Signal handler for SIGINT (Ctrl+C). This function is called when the user presses Ctrl+C or when they toggle the switch. */
-	char user_input;
-	
+    ///* Signal handler for SIGINT (Ctrl+C). This function is called when the user presses Ctrl+C. */
     stop_flag = 1;
     printf("\033[2J\033[H");
+    save_prompt();
+}
+
+void save_prompt() {
+    ///* Ask whether to save the current values to the settings file, and save them if so. */
+	char user_input;
+	wave_params_t p;
+
     printf("\n[INFO] Would you like to save the values? (y/n)\n");
 	while (1) {
 		scanf(" %c", &user_input);
 		if (user_input == 'y' || user_input == 'Y') {
 			printf("[INFO] Saving settings to file\n");
-			save_settings(SETTING_FILE, amplitude, frequency, mean);
+			params_read(&params, &p);
+			save_settings(SETTING_FILE, &p);
 			break;
 		}
 		else if (user_input == 'n' || user_input == 'N') {
@@ -255,116 +410,502 @@ void sigint_handler(int sig) {
 	delay(500);
 }
 
-void write_to_dac(unsigned short val) {
-    ///* Function to write the value to the DAC. */
-    out16(DA_CTLREG, 0x0a23);
-    out16(DA_FIFOCLR, 0);
-    out16(DA_Data, val);
-    out16(DA_CTLREG, 0x0a43);
-    out16(DA_FIFOCLR, 0);
-    out16(DA_Data, val);
+void write_to_dac(dac_frame_t frame) {
+    ///* Function to write one frame to the two DAC channels. The #0-#1 scan control word only goes out when it is not already set, so a sample normally costs just the two data writes, back to back; the cycles between them are the skew between the channels. */
+    uint64_t start, skew;
+
+    if (das_out16_shadow(DAS_SHADOW_DA_CTL, DA_CTLREG, DAC_CTL_SW_SCAN)) {
+        das_out16(DA_FIFOCLR, 0);	// restart the scan at #0
+    }
+    start = jitter_cycles();
+    das_out16(DA_Data, DAC_FRAME_CH0(frame));
+    das_out16(DA_Data, DAC_FRAME_CH1(frame));
+    skew = jitter_cycles() - start;
+    skew_cycles_total += skew;
+    if (skew > skew_cycles_max) skew_cycles_max = skew;
 }
 
-void* waveform_thread(void* arg) {
-    ///* Thread function to generate the waveform. This function runs in an infinite loop until the stop_flag is set. */
-    int i, type, delay_us;
-    float delta, voltage, amp, offset, freq;
-    unsigned short dac_value;
+void publish_waveform() {
+    ///* Render the latest settings into the back table and hand it to the output thread, which switches over at the end of its current cycle. Call after params_commit(); whichever writer publishes last renders the newest snapshot. */
+    wave_params_t p;
 
-    delta = (2.0 * PI) / NUM_POINTS;
+    params_read(&params, &p);
+    wave_tables_publish(&tables, p.wave_type, p.amplitude, p.frequency, p.mean);
+}
+
+void set_wave_type(int type) {
+    ///* Change only the waveform type and publish it. */
+    wave_params_t p;
+
+    params_begin(&params, &p);
+    p.wave_type = type;
+    params_commit(&params, &p);
+    publish_waveform();
+}
+
+void* status_thread(void* arg) {
+    ///* Thread function that owns the terminal status line. Samples the parameters at most 20 times a second and rewrites only the fields that changed; notes posted by other threads are printed above it. No other thread prints the line, so terminal I/O never runs in a control or real-time thread. */
+    static const char* label[STATUS_FIELDS] = { "[INFO] Frequency: ", " Hz | Amplitude: ", " V | Mean: " };
+    char field[STATUS_FIELDS][16], shown[STATUS_FIELDS][16];
+    int col[STATUS_FIELDS], i, changed, resized, error_shown = 0, drawn;
+    const char* note;
+    wave_params_t p;
+
+    // Column of each field in the line, its width fixed by the formats below
+    for (i = 0; i < STATUS_FIELDS; i++) {
+        col[i] = (i ? col[i - 1] + (i == 1 ? 7 : 4) : 0) + strlen(label[i]);
+        shown[i][0] = '\0';
+    }
 
     while (!stop_flag) {
-        amp = amplitude;
-        offset = mean;
-        freq = frequency;
-        type = wave_type;
-
-        delay_us = (int)(1.0 / freq / NUM_POINTS * 1e6);
-
-        // Different waveform types and their corresponding calculations
-        for (i = 0; i < NUM_POINTS && !stop_flag; i++) {
-            switch (type) {
-                case 0: voltage = offset + amp * sin(delta * i); break;
-                case 1: voltage = (i < NUM_POINTS / 2) ? (offset + amp) : (offset - amp); break;
-                case 2: voltage = (i < NUM_POINTS / 2) ? (offset - amp + (2 * amp * i) / (NUM_POINTS / 2)) : (offset + amp - (2 * amp * (i - NUM_POINTS / 2)) / (NUM_POINTS / 2)); break;
-                case 3: voltage = offset - amp + (2 * amp * i) / (NUM_POINTS - 1); break;
-                default: voltage = offset; break;
+        drawn = 0;
+        if ((note = rt_exchange(&status_note, (const char*)NULL)) != NULL) {
+            printf("%s", note);
+            status_dirty = 1;
+            drawn = 1;
+        }
+
+        params_read(&params, &p);
+        snprintf(field[0], sizeof(field[0]), "%7.2f", p.frequency);
+        snprintf(field[1], sizeof(field[1]), "%4.2f", p.amplitude);
+        snprintf(field[2], sizeof(field[2]), "%4.2f", p.mean);
+        for (i = 0, changed = 0, resized = 0; i < STATUS_FIELDS; i++) {
+            changed |= strcmp(field[i], shown[i]) != 0;
+            resized |= strlen(field[i]) != strlen(shown[i]);	// columns moved, patching in place would garble the line
+        }
+
+        if (rt_exchange(&status_adjusted, 0)) {
+            // Stays up until a value changes or other output needs the line redrawn
+            printf("\r[ERROR] Waveform exceeds max voltage range. Adjusting values: Frequency: %.2f Hz | Amplitude: %.2f V | Mean: %.2f V", p.frequency, p.amplitude, p.mean);
+            error_shown = 1;
+            drawn = 1;
+        }
+        else if (status_dirty || resized || (error_shown && changed)) {
+            printf("\r%s%s%s%s%s%s V                                                       ", label[0], field[0], label[1], field[1], label[2], field[2]);
+            status_dirty = 0;
+            error_shown = 0;
+            drawn = 1;
+        }
+        else if (changed && !error_shown) {
+            for (i = 0; i < STATUS_FIELDS; i++) {
+                if (strcmp(field[i], shown[i]) != 0) printf("\r\033[%dC%s", col[i], field[i]);
             }
-            if (voltage < 0.0) voltage = 0.0;
-            if (voltage > 5.0) voltage = 5.0;
-
-            dac_value = (unsigned short)((voltage / 5.0) * 0xFFFF);
-            write_to_dac(dac_value);
-            
-            if (change_waveform) {
-            	change_waveform = 0;
-            	break;
+            drawn = 1;
+        }
+        if (drawn) {
+            memcpy(shown, field, sizeof(shown));
+            fflush(stdout);
+        }
+        usleep(STATUS_PERIOD_US);
+    }
+    // A note posted on the way out, e.g. by the kill switch, is still shown
+    if ((note = rt_exchange(&status_note, (const char*)NULL)) != NULL) {
+        printf("%s", note);
+        fflush(stdout);
+    }
+    return NULL;
+}
+
+int mod_parse(const char* spec, double rate) {
+    ///* Set up the modulation described by spec, am|fm|pm:modulator:depth:rate, where the modulator is a waveform name and the depth is the AM index (0-1), the FM deviation in Hz or the PM deviation in radians (up to pi, a half cycle either way). Returns -1 if spec is invalid. */
+    char kind[4], shape[16];
+    float depth, mod_rate;
+    int type, k;
+
+    if (sscanf(spec, "%3[a-z]:%15[a-z]:%f:%f", kind, shape, &depth, &mod_rate) != 4) {
+        return -1;
+    }
+    for (type = 0; type < DDS_WAVE_COUNT && strcasecmp(shape, wave_names[type]); type++);
+    if (!strcmp(kind, "am")) k = MOD_AM;
+    else if (!strcmp(kind, "fm")) k = MOD_FM;
+    else if (!strcmp(kind, "pm")) k = MOD_PM;
+    else return -1;
+
+    if (type == DDS_WAVE_COUNT || depth < 0.0f || (k == MOD_AM && depth > 1.0f) || (k == MOD_FM && depth > frequency_limit) ||
+        (k == MOD_PM && depth > M_PI) || mod_rate <= 0.0f || mod_rate > frequency_limit) {
+        return -1;
+    }
+    mod_setup(&modulation, k, type, depth, mod_rate, rate);
+    return 0;
+}
+
+int channel1_setup(const char* spec, double rate) {
+    ///* Render DAC #1's table from spec, wave:frequency:amplitude:mean:phase, phase in degrees ahead of DAC #0. Frequency 0 locks DAC #1 to DAC #0's frequency, so the phase offset holds through every change (90 for quadrature, 180 for a differential pair). Returns -1 if spec is invalid. */
+    char shape[16];
+    float frequency, amplitude, mean, degrees;
+    int type;
+
+    if (sscanf(spec, "%15[a-z]:%f:%f:%f:%f", shape, &frequency, &amplitude, &mean, &degrees) != 5) {
+        return -1;
+    }
+    for (type = 0; type < DDS_WAVE_COUNT && strcasecmp(shape, wave_names[type]); type++);
+    if (type == DDS_WAVE_COUNT || (frequency != 0.0f && (frequency < FREQUENCY_MIN || frequency > frequency_limit)) ||
+        amplitude < AMPLITUDE_MIN || amplitude > AMPLITUDE_MAX || mean < MEAN_MIN || mean > MEAN_MAX || amplitude > mean) {
+        return -1;
+    }
+    wave_table_render(&channel1_table, rate, type, amplitude, frequency, mean);
+    degrees = fmodf(degrees, 360.0f);
+    if (degrees < 0.0f) degrees += 360.0f;
+    channel1_offset = (uint32_t)(degrees / 360.0 * DDS_PHASE_CYCLE);
+    channel1_dds.phase = channel1_offset;
+    channel1_dds.tuning = channel1_table.tuning;
+    channel1_render = (frequency == 0.0f) ? channel1_locked : channel1_free;
+    return 0;
+}
+
+int sweep_setup(const char* spec, const wave_params_t* p, double rate) {
+    ///* Start the sweep described by spec, lin|log:f0:f1:seconds, optionally followed by :a0:a1 for an amplitude ramp (else the amplitude stays at p's) and :once for a one-shot sweep (else it repeats). Returns -1 if spec is invalid. */
+    char shape[4], tail[32];
+    float f0, f1, a0 = p->amplitude, a1 = p->amplitude;
+    double seconds;
+    int n, once = 0;
+
+    tail[0] = '\0';
+    if (sscanf(spec, "%3[a-z]:%f:%f:%lf%31s", shape, &f0, &f1, &seconds, tail) < 4 || (strcmp(shape, "lin") && strcmp(shape, "log"))) {
+        return -1;
+    }
+    if (tail[0] == ':' && sscanf(tail, ":%f:%f%n", &a0, &a1, &n) == 2) {
+        memmove(tail, tail + n, strlen(tail + n) + 1);
+    }
+    if (!strcmp(tail, ":once")) once = 1;
+    else if (tail[0] != '\0') return -1;
+
+    if (f0 < FREQUENCY_MIN || f0 > frequency_limit || f1 < FREQUENCY_MIN || f1 > frequency_limit ||
+        a0 < AMPLITUDE_MIN || a0 > AMPLITUDE_MAX || a1 < AMPLITUDE_MIN || a1 > AMPLITUDE_MAX) {
+        return -1;
+    }
+    return sweep_start(&sweep, strcmp(shape, "log") ? SWEEP_LINEAR : SWEEP_LOG, f0, f1, a0, a1, seconds, rate, !once);
+}
+
+void render_table(producer_t* pr, unsigned short* block, uint32_t* phase) {
+    ///* DAC #0 renderer for a plain waveform: one table lookup per sample. New settings take effect at the end of a cycle. */
+    int i;
+
+    for (i = 0; i < PRODUCER_BLOCK; i++) {
+        phase[i] = pr->dds.phase;
+        block[i] = pr->table->code[dds_index(&pr->dds)];
+        if (dds_step(&pr->dds)) {
+            pr->table = wave_tables_swap(&tables, pr->table);
+            pr->dds.tuning = pr->table->tuning;
+        }
+    }
+}
+
+void render_sweep(producer_t* pr, unsigned short* block, uint32_t* phase) {
+    ///* DAC #0 renderer for a sweep: shape and mean from the table, frequency and amplitude from the sweep. Reports a one-shot sweep finishing. */
+    int i, sweeping = sweep.active;
+    float amplitude;
+
+    for (i = 0; i < PRODUCER_BLOCK; i++) {
+        phase[i] = pr->dds.phase;
+        amplitude = sweep_step(&sweep, &pr->dds);
+        block[i] = voltage_to_dac(pr->table->mean + amplitude * dds_shape[pr->table->type][dds_index(&pr->dds)]);
+        if (dds_step(&pr->dds)) {
+            pr->table = wave_tables_swap(&tables, pr->table);
+        }
+    }
+    if (sweeping && !sweep.active) {
+        status_note = "\n[INFO] Sweep finished, holding the end frequency and amplitude ('w' to run it again)\n";
+    }
+}
+
+void render_modulated(producer_t* pr, unsigned short* block, uint32_t* phase) {
+    ///* DAC #0 renderer for modulation: the carrier is the table's waveform on the table's phase accumulator. New settings are picked up between blocks. */
+    wave_table_t* next;
+
+    mod_carrier(&modulation, pr->table->type, pr->table->amplitude, pr->table->mean);
+    modulation.render(&modulation, &pr->dds, block, phase, PRODUCER_BLOCK);
+    if ((next = wave_tables_swap(&tables, pr->table)) != pr->table) {
+        pr->table = next;
+        pr->dds.tuning = next->tuning;
+    }
+}
+
+void render_arbitrary(producer_t* pr, unsigned short* block, uint32_t* phase) {
+    ///* DAC #0 renderer for the arbitrary waveform file. A file has no cycle end to wait for, so new settings are picked up between blocks. */
+    wave_table_t* next;
+    int i;
+
+    awg_set_speed(&awg, pr->table->frequency, tables.sample_rate);
+    awg_read(&awg, block, PRODUCER_BLOCK);
+    for (i = 0; i < PRODUCER_BLOCK; i++) {
+        phase[i] = pr->dds.phase;
+    }
+    if ((next = wave_tables_swap(&tables, pr->table)) != pr->table) {
+        pr->table = next;
+        pr->dds.phase = 0;
+        pr->dds.tuning = next->tuning;
+    }
+}
+
+void channel1_copy(dac_frame_t* frames, const unsigned short* block, const uint32_t* phase) {
+    ///* DAC #1 renderer without -d: the same code as DAC #0. */
+    int i;
+
+    (void)phase;				// only channel1_locked follows DAC #0's phase
+
+    for (i = 0; i < PRODUCER_BLOCK; i++) {
+        frames[i] = DAC_FRAME(block[i], block[i]);
+    }
+}
+
+void channel1_locked(dac_frame_t* frames, const unsigned short* block, const uint32_t* phase) {
+    ///* DAC #1 renderer locked to DAC #0: its own table at DAC #0's phase plus the offset. */
+    int i;
+
+    for (i = 0; i < PRODUCER_BLOCK; i++) {
+        frames[i] = DAC_FRAME(block[i], channel1_table.code[(phase[i] + channel1_offset) >> DDS_INDEX_SHIFT]);
+    }
+}
+
+void channel1_free(dac_frame_t* frames, const unsigned short* block, const uint32_t* phase) {
+    ///* DAC #1 renderer at its own frequency, on its own phase accumulator. */
+    int i;
+
+    (void)phase;				// only channel1_locked follows DAC #0's phase
+
+    for (i = 0; i < PRODUCER_BLOCK; i++) {
+        frames[i] = DAC_FRAME(block[i], channel1_table.code[dds_index(&channel1_dds)]);
+        channel1_dds.phase += channel1_dds.tuning;
+    }
+}
+
+void* sample_producer_thread(void* arg) {
+    ///* Thread function that renders DAC frames into the sample ring, a block at a time, so the output thread never computes anything: DAC #0 from the DDS or the arbitrary waveform file, DAC #1 from its own table or as a copy of #0. Runs below the output thread's priority. */
+    unsigned short block[PRODUCER_BLOCK];
+    uint32_t phase[PRODUCER_BLOCK];		// DAC #0 phase of each sample, for a locked DAC #1
+    dac_frame_t frames[PRODUCER_BLOCK];
+    uint32_t lead, queued;
+    producer_t pr;
+    render_fn render;
+
+    lead = (uint32_t)(tables.sample_rate * PRODUCER_LEAD);
+    if (lead < 2 * PRODUCER_BLOCK) lead = 2 * PRODUCER_BLOCK;
+    if (lead > SPSC_RING_SIZE) lead = SPSC_RING_SIZE;
+    pr.table = (wave_table_t*)arg;
+    pr.dds.phase = 0;
+    pr.dds.tuning = pr.table->tuning;
+
+    while (!stop_flag) {
+        queued = spsc_ring_count(&sample_ring);
+        if (queued + PRODUCER_BLOCK > lead) {
+            // Far enough ahead, sleep until about half the lead has been played
+            usleep((useconds_t)((queued - lead / 2) / tables.sample_rate * 1e6) + 1);
+            continue;
+        }
+
+        if (pr.table->type == ARBITRARY) {
+            render = render_arbitrary;
+        }
+        else if (mod_on) {
+            render = render_modulated;
+        }
+        else {
+            if (rt_exchange(&sweep_toggle, 0)) {
+                // Stopping hands the frequency back to the table, a finished one-shot sweep runs again; the phase carries on either way
+                if (sweep_on && sweep.active) {
+                    pr.dds.tuning = pr.table->tuning;
+                    sweep_on = 0;
+                }
+                else {
+                    sweep_restart(&sweep);
+                    sweep_on = 1;
+                }
             }
+            render = sweep_on ? render_sweep : render_table;
+        }
+        render(&pr, block, phase);
+        channel1_render(frames, block, phase);
+        spsc_ring_push(&sample_ring, frames, PRODUCER_BLOCK);
+    }
+    return NULL;
+}
+
+void* waveform_thread(void* arg) {
+    ///* Thread function to output the waveform. Pops one ready frame per sample period and writes it, woken either on an absolute deadline or by a timer pulse; on an underrun the last frame is held. */
+    unsigned long dropped;
+    dac_frame_t frame;
+    wave_params_t p;
+    int64_t due = 0;
+
+    params_read(&params, &p);
+    frame = DAC_FRAME(voltage_to_dac(p.mean), voltage_to_dac(channel1_spec ? channel1_table.mean : p.mean));
+
+    if (timer_driven && rt_ticker_start(&output_ticker, SW_SAMPLE_RATE, late_policy) == -1) {
+        printf("[ERROR] Could not start the output timer, using deadline timing\n");
+        timer_driven = 0;
+    }
+    if (!timer_driven) {
+        rt_deadline_start(&output_deadline, SW_SAMPLE_RATE, spin_window_us * 1000LL, late_policy);
+    }
+
+    while (!stop_flag) {
+        if (!spsc_ring_pop(&sample_ring, &frame)) {
+            underruns++;
+        }
+        write_to_dac(frame);
+        jitter_sample(&output_jitter, due);
+        samples_written++;
+
+        // Samples whose slots were skipped are dropped so the output stays in phase
+        dropped = timer_driven ? rt_ticker_wait(&output_ticker) : rt_deadline_wait(&output_deadline);
+        while (dropped-- > 0) {
+            spsc_ring_pop(&sample_ring, &frame);
+        }
+
+        // Deadline the next write is for; the timer pulse has none to compare with
+        due = timer_driven ? 0 : output_deadline.next_ns - output_deadline.period_ns;
+    }
+
+    if (timer_driven) {
+        rt_ticker_stop(&output_ticker);
+    }
+    return NULL;
+}
 
-            usleep(delay_us);
+double pacer_rate(double rate) {
+    ///* The scan rate the 10 MHz time base actually gives for the requested one, without touching the counters. */
+    unsigned long div1, div2;
+
+    if (rate > PACER_RATE_MAX) rate = PACER_RATE_MAX;
+    return das_8254_divisors(rate, &div1, &div2);
+}
+
+double pacer_set_rate(double rate) {
+    ///* Program the cascaded pacer counters for the requested scan rate, which starts the pacer. Returns the rate the 10 MHz time base actually gives. */
+    if (rate > PACER_RATE_MAX) rate = PACER_RATE_MAX;
+    return das_8254_cascade(PACERCTL, PACER2, PACER3, rate);
+}
+
+void pacer_stop() {
+    ///* Stop the pacer counters and return the DAC to software updates, so nothing drains the DA FIFO. */
+    das_8254_hold(PACERCTL);
+    das_out16_shadow(DAS_SHADOW_DA_CTL, DA_CTLREG, DAC_CTL_SW_SCAN);
+    das_out16(DA_FIFOCLR, 0);
+}
+
+void* pacer_waveform_thread(void* arg) {
+    ///* Thread function for hardware-paced output. The on-board pacer clocks scans out of the DA FIFO at the rate set up in main(); this thread only moves ready frames from the sample ring into the FIFO, half a FIFO at a time. */
+    dac_frame_t frames[DA_FIFO_HALF / 2];
+    unsigned short block[DA_FIFO_HALF];
+    dac_frame_t last;
+    uint32_t i, n;
+    int blocks, refill_us;
+    wave_params_t p;
+
+    params_read(&params, &p);
+    last = DAC_FRAME(voltage_to_dac(p.mean), voltage_to_dac(channel1_spec ? channel1_table.mean : p.mean));
+
+    refill_us = (int)((DA_FIFO_HALF / 2) / tables.sample_rate / 4 * 1e6);
+    if (refill_us < 1000) refill_us = 1000;
+    pacer_stop();
+
+    // Pacer-clocked FIFO mode with the counters still stopped, so the first two halves fill the FIFO
+    das_out16_shadow(DAS_SHADOW_DA_CTL, DA_CTLREG, DAC_CTL_PACER_SCAN);
+    das_out16(DA_FIFOCLR, 0);
+    for (blocks = 0; !stop_flag; blocks++) {
+        if (blocks == 2) {
+            pacer_set_rate(PACER_SAMPLE_RATE);		// FIFO full, start the pacer
         }
+        while (blocks >= 2 && !stop_flag && !(das_in16(INTERRUPT) & DAC_STAT_HALF_EMPTY)) {
+            usleep(refill_us);
+        }
+
+        n = spsc_ring_pop_block(&sample_ring, frames, DA_FIFO_HALF / 2);
+        if (n < DA_FIFO_HALF / 2) {
+            underruns += DA_FIFO_HALF / 2 - n;
+        }
+
+        // Channel #0 and #1 are interleaved in the FIFO, one scan per pacer tick
+        for (i = 0; i < DA_FIFO_HALF / 2; i++) {
+            if (i < n) last = frames[i];
+            block[2 * i] = DAC_FRAME_CH0(last);
+            block[2 * i + 1] = DAC_FRAME_CH1(last);
+        }
+        das_out16s(DA_Data, block, DA_FIFO_HALF);
+        samples_written += DA_FIFO_HALF / 2;
     }
+
+    pacer_stop();
     return NULL;
 }
 
+void pot_task(void* arg) {
+    ///* Drain the potentiometer scans and, in Hardware Control Mode, post the pot codes to the potentiometer thread when one has moved past POT_DEADBAND. Takes no lock and renders nothing, so it never blocks the cyclic executive; pot_apply() does the commit and re-render. */
+    static int last_amplitude = -1, last_frequency = -1;	// codes last posted, -1 to post on entering Hardware Control Mode
+    int amplitude, frequency;
+
+    das_adc_scan_poll(&pot_adc);
+
+    if (control_mode != 1) {
+        last_amplitude = last_frequency = -1;
+        return;
+    }
+
+    amplitude = pot_adc.latest[POT_CHAN_AMPLITUDE];
+    frequency = pot_adc.latest[POT_CHAN_FREQUENCY];
+    if (last_amplitude >= 0 && abs(amplitude - last_amplitude) <= POT_DEADBAND && abs(frequency - last_frequency) <= POT_DEADBAND) {
+        return;
+    }
+    last_amplitude = amplitude;
+    last_frequency = frequency;
+    rt_exchange(&pot_posted, POT_POSTED | (uint64_t)amplitude << 16 | (uint64_t)frequency);
+}
+
+void pot_apply() {
+    ///* Turn the pot codes posted by pot_task() into the amplitude and frequency, commit them and re-render the table. Takes the params and table locks, so it runs in the potentiometer thread, never in the cyclic executive. */
+    uint64_t posted;
+    int amplitude, frequency;
+    wave_params_t p;
+
+    if ((posted = rt_exchange(&pot_posted, (uint64_t)0)) == 0 || control_mode != 1) {
+        return;
+    }
+    amplitude = (int)((posted >> 16) & 0xFFFF);
+    frequency = (int)(posted & 0xFFFF);
+
+    params_begin(&params, &p);
+    p.mean = 2.5;
+
+    // Amplitude control using channel 0
+    p.amplitude = ((float)amplitude / 65535.0f) * AMPLITUDE_MAX;
+    if (p.amplitude < 0.1) {
+        p.amplitude = 0.1;
+    }
+
+    // Frequency control using channel 1
+    p.frequency = 1.0f + ((float)frequency / 65535.0f) * (frequency_limit - 1.0f);
+    params_commit(&params, &p);
+    publish_waveform();
+}
+
 void* potentiometer_thread(void* arg) {
-    ///* Thread function to read the potentiometer values and adjust the waveform parameters (amplitude, frequency) accordingly. */
-    unsigned short raw[2];
-    int local_mode;
-    int count;
-    unsigned short chan;
+    ///* Thread function to adjust the waveform parameters (amplitude, frequency) from the potentiometers. Reads them itself unless the cyclic executive does, and always applies what was read. */
 
-    while (!stop_flag) {
+    // Both potentiometers are scanned by the card itself; the loop only drains the AD FIFO
+    if (!cyclic) {
+        das_adc_open(&pot_adc, 1);
+        das_adc_scan_start(&pot_adc, POT_CHAN_AMPLITUDE, POT_CHAN_FREQUENCY, POT_SCAN_RATE, 0);
+    }
 
-        // Use of mutexes to ensure thread safety when accessing shared variables
-        pthread_mutex_lock(&control_mutex);
-        local_mode = control_mode;
-        pthread_mutex_unlock(&control_mutex);
-        
-        if (local_mode == 1) {
-        	mean = 2.5;
-
-	        out16(INTERRUPT, 0x60c0);
-	        out16(TRIGGER, 0x2081);
-	        out16(AUTOCAL, 0x007f);
-	        out16(AD_FIFOCLR, 0);
-            
-            // Set the mux channel to read from the potentiometer
-	        for (count = 0; count < 2; count++) {
-	            chan = ((count & 0x0f) << 4) | (0x0f & count);
-	            out16(MUXCHAN, 0x0D00 | chan);   // Select channel
-	            usleep(1000);                    // Let mux settle
-	            out16(AD_DATA, 0);               // Start ADC conversion
-	
-	            // Wait for conversion to complete
-	            while (!(in16(MUXCHAN) & 0x4000));
-	            raw[count] = in16(AD_DATA);
-	        }
-	
-	        // Amplitude control using channel 0
-	        amplitude = ((float)raw[0] / 65535.0f) * AMPLITUDE_MAX;
-	        if (amplitude < 0.1) {
-	        	amplitude = 0.1;
-	        }
-	
-	        // Frequency control using channel 1
-	        frequency = 1.0f + ((float)raw[1] / 65535.0f) * 9.0f;
-	
-	        printf("\r[INFO] Frequency: %.2f Hz | Amplitude: %.2f V | Mean: %.2f V                                                       ", frequency, amplitude, mean);
-	        
-	        fflush(stdout);
-        }
-	
-	        usleep(10000); // Delay to prevent excessive polling
-	    }
+    while (!stop_flag) {
+        if (!cyclic) pot_task(NULL);
+        pot_apply();
+        usleep(10000); // Delay to prevent excessive polling
+    }
 
+    if (!cyclic) {
+        das_adc_scan_stop(&pot_adc);
+        das_adc_close(&pot_adc);
+    }
     return NULL;
 }
 
 void* kbd_control(void* arg) {
     ///* Thread function to handle keyboard input for controlling the waveform parameters (amplitude, frequency, mean, waveform type). */
     char c;
-    int local_mode;
+    int adjusted;
+    wave_params_t p;
     struct termios oldt, newt;
     fd_set readfds;
     struct timeval tv;
@@ -382,11 +923,17 @@ void* kbd_control(void* arg) {
         printf("  - '2': Square Wave\n");
         printf("  - '3': Triangle Wave\n");
         printf("  - '4': Sawtooth Wave\n");
+        printf("  - '5': Pulse Wave\n");
+        printf("  - '6': Cardiac Wave\n");
+        if (awg_filename) printf("  - '7': Arbitrary Wave (%s)\n", awg_filename);
+        if (sweep_spec) printf("  - 'w': Stop / start the sweep (%s)\n", sweep_spec);
+        if (mod_spec) printf("  - 'o': Modulation on / off (%s)\n", mod_spec);
         printf("\n");
-        printf("  - Arrow UP/DOWN: Increase / Decrease Frequency (1.0 - 10.0 Hz)\n");
+        printf("  - Arrow UP/DOWN: Increase / Decrease Frequency (1.0 - %.1f Hz)\n", frequency_limit);
         printf("  - Arrow LEFT/RIGHT: Increase / Decrease Amplitude (0.1 - 2.5 V)\n");
         printf("\n");
         printf(" Press 'm' to switch to Hardware Control Mode\n");
+        printf(" Press 'i' to show the output timing\n");
         printf(" Press 'e' to exit the program\n");
         printf(" Or Toggle Switch 1 (Kill Switch) to shut down immediately\n");
         printf("-----------------------------------------------------------\n");
@@ -405,11 +952,11 @@ void* kbd_control(void* arg) {
         printf("   Switch 4: Select Sawtooth Wave\n");
         printf("\n");
         printf(" Press 'm' to switch back to Keyboard Control Mode\n");
+        printf(" Press 'i' to show the output timing\n");
         printf("-----------------------------------------------------------\n");
 
     }
-	printf("\r[INFO] Frequency: %.2f Hz | Amplitude: %.2f V | Mean: %.2f V                                                       ", frequency, amplitude, mean);
-    fflush(stdout);
+    status_dirty = 1;
     while (!stop_flag) {
         FD_ZERO(&readfds);
         FD_SET(STDIN_FILENO, &readfds);
@@ -420,72 +967,48 @@ void* kbd_control(void* arg) {
             c = getchar();
             if (c == '\033') {
                 getchar();
-                switch(getchar()) {
+                c = getchar();
+                if (control_mode != 0) continue;
+                adjusted = 0;
+
+                // Edit a copy under the writer lock; print and render after committing it
+                params_begin(&params, &p);
+                switch(c) {
                     case 'A':
-                        pthread_mutex_lock(&control_mutex);
-                        if (control_mode == 0) {
-                            if (frequency < 10.0f) frequency += 0.1f;
-                            else frequency = 10.0f;
-                            printf("\r[INFO] Frequency: %.2f Hz | Amplitude: %.2f V | Mean: %.2f V                                                       ", frequency, amplitude, mean);
-                            fflush(stdout);
-                        }
-                        pthread_mutex_unlock(&control_mutex);
+                        if (p.frequency < frequency_limit) p.frequency += 0.1f;
+                        else p.frequency = frequency_limit;
                         break;
                     case 'B':
-                        pthread_mutex_lock(&control_mutex);
-                        if (control_mode == 0) {
-                            if (frequency > 1.0f) frequency -= 0.1f;
-                            else frequency = 1.0f;
-                            printf("\r[INFO] Frequency: %.2f Hz | Amplitude: %.2f V | Mean: %.2f V                                                       ", frequency, amplitude, mean);
-                            fflush(stdout);
-                        }
-                        pthread_mutex_unlock(&control_mutex);
+                        if (p.frequency > 1.0f) p.frequency -= 0.1f;
+                        else p.frequency = 1.0f;
                         break;
                     case 'C':
-                        pthread_mutex_lock(&control_mutex);
-                        if (control_mode == 0) {
-                            if (amplitude < AMPLITUDE_MAX) amplitude += 0.1f;
-                            else amplitude = AMPLITUDE_MAX;
-                            
-                            if (amplitude > mean) {
-                            	amplitude = mean;
-                            	printf("\r[ERROR] Waveform exceeds max voltage range. Adjusting values: Frequency: %.2f Hz | Amplitude: %.2f V | Mean: %.2f V", frequency, amplitude, mean);
-                            	fflush(stdout);
-                            }
-                            else {
-                            
-	                            printf("\r[INFO] Frequency: %.2f Hz | Amplitude: %.2f V | Mean: %.2f V                                                       ", frequency, amplitude, mean);
-	                            fflush(stdout);
-                            }
-                        }
-                        pthread_mutex_unlock(&control_mutex);
+                        if (p.amplitude < AMPLITUDE_MAX) p.amplitude += 0.1f;
+                        else p.amplitude = AMPLITUDE_MAX;
                         break;
                     case 'D':
-                        pthread_mutex_lock(&control_mutex);
-                        if (control_mode == 0) {
-                            if (amplitude > 0.1f) amplitude -= 0.1f;
-                            else amplitude = 0.1f;
-                            
-                            if (amplitude > mean) {
-                            	amplitude = mean;
-                            	printf("\r[ERROR] Waveform exceeds max voltage range. Adjusting values: Frequency: %.2f Hz | Amplitude: %.2f V | Mean: %.2f V", frequency, amplitude, mean);
-                            	fflush(stdout);
-                            }
-                            else {
-	                            printf("\r[INFO] Frequency: %.2f Hz | Amplitude: %.2f V | Mean: %.2f V                                                       ", frequency, amplitude, mean);
-	                            fflush(stdout);
-                            }
-                        }
-                        pthread_mutex_unlock(&control_mutex);
+                        if (p.amplitude > 0.1f) p.amplitude -= 0.1f;
+                        else p.amplitude = 0.1f;
                         break;
                 }
+                if (p.amplitude > p.mean) {
+                    p.amplitude = p.mean;
+                    adjusted = 1;
+                }
+                params_commit(&params, &p);
+                publish_waveform();
+                if (adjusted) status_adjusted = 1;
             } else {
-                pthread_mutex_lock(&control_mutex);
-                local_mode = control_mode;
-                pthread_mutex_unlock(&control_mutex);
-
-                if (c == 'm') {
-                    pthread_mutex_lock(&control_mutex);
+                if (c == 'i') {
+                    // Live reading of the output thread's counters
+                    printf("\n");
+                    if (output_mode == OUTPUT_SOFTWARE) jitter_summary(&output_jitter);
+                    else printf("[INFO] Output timing is kept by the pacer in hardware-paced mode\n");
+                    if (sweep_on) printf("[INFO] Sweep: %.2f Hz, amplitude %.2f V, %lu sweeps done\n", sweep_frequency(&sweep, tables.sample_rate), sweep.amplitude, sweep.sweeps);
+                    fflush(stdout);
+                    status_dirty = 1;
+                }
+                else if (c == 'm') {
                     control_mode = (control_mode == 0) ? 1 : 0;
                     if (control_mode == 0) {
                         printf("\033[2J\033[H");
@@ -496,11 +1019,17 @@ void* kbd_control(void* arg) {
                         printf("  - '2': Square Wave\n");
                         printf("  - '3': Triangle Wave\n");
                         printf("  - '4': Sawtooth Wave\n");
+                        printf("  - '5': Pulse Wave\n");
+                        printf("  - '6': Cardiac Wave\n");
+                        if (awg_filename) printf("  - '7': Arbitrary Wave (%s)\n", awg_filename);
+                        if (sweep_spec) printf("  - 'w': Stop / start the sweep (%s)\n", sweep_spec);
+                        if (mod_spec) printf("  - 'o': Modulation on / off (%s)\n", mod_spec);
                         printf("\n");
-                        printf("  - Arrow UP/DOWN: Increase / Decrease Frequency (1.0 - 10.0 Hz)\n");
+                        printf("  - Arrow UP/DOWN: Increase / Decrease Frequency (1.0 - %.1f Hz)\n", frequency_limit);
                         printf("  - Arrow LEFT/RIGHT: Increase / Decrease Amplitude (0.1 - 2.5 V)\n");
                         printf("\n");
                         printf(" Press 'm' to switch to Hardware Control Mode\n");
+                        printf(" Press 'i' to show the output timing\n");
                         printf(" Press 'e' to exit the program\n");
                         printf(" Or Toggle Switch 1 (Kill Switch) to shut down immediately\n");
                         printf("-----------------------------------------------------------\n");
@@ -520,51 +1049,41 @@ void* kbd_control(void* arg) {
                         printf("   Switch 4: Select Sawtooth Wave\n");
                         printf("\n");
                         printf(" Press 'm' to switch back to Keyboard Control Mode\n");
+                        printf(" Press 'i' to show the output timing\n");
                         printf("-----------------------------------------------------------\n");
 
                     }
-                    pthread_mutex_unlock(&control_mutex);
+                    status_dirty = 1;
                 }
-
-                if (local_mode == 0) {
+                else if (control_mode == 0) {
                     if (c == 'e') stop_flag = 1;
-                    if (c >= '1' && c <= '4') {
-                        wave_type = c - '1';
-                        change_waveform = 1;
-                        printf("\n[INFO] Waveform type set to %s \n", wave_names[wave_type]);
-                        fflush(stdout);
+                    if (c == 'w' && sweep_spec) sweep_toggle = 1;
+                    if (c == 'o' && mod_spec) {
+                        mod_on = !mod_on;
+                        status_note = mod_on ? "\n[INFO] Modulation on\n" : "\n[INFO] Modulation off\n";
                     }
-                    if (c == 'k') {
-                        pthread_mutex_lock(&control_mutex);
-                        if (mean < MEAN_MAX) mean += 0.1f;
-                        else mean = MEAN_MAX;
-                        
-						if (amplitude > mean) {
-							mean = amplitude;
-                        	printf("\r[ERROR] Waveform exceeds max voltage range. Adjusting values: Frequency: %.2f Hz | Amplitude: %.2f V | Mean: %.2f V", frequency, amplitude, mean);
-                        	fflush(stdout);
-                        }
-                        else {
-		                    printf("\r[INFO] Frequency: %.2f Hz | Amplitude: %.2f V | Mean: %.2f V                                                       ", frequency, amplitude, mean);
-		                    fflush(stdout);
-                        }
-                        pthread_mutex_unlock(&control_mutex);
+                    if ((c >= '1' && c <= '6') || (c == '7' && awg_filename)) {
+                        set_wave_type(c - '1');
+                        status_note = wave_set_notes[c - '1'];
                     }
-                    if (c == 'j') {
-                        pthread_mutex_lock(&control_mutex);
-                        if (mean > 0.0f) mean -= 0.1f;
-                        else mean = 0.0f;
-                        
-						if (amplitude > mean) {
-							mean = amplitude;
-                        	printf("\r[ERROR] Waveform exceeds max voltage range. Adjusting values: Frequency: %.2f Hz | Amplitude: %.2f V | Mean: %.2f V", frequency, amplitude, mean);
-                        	fflush(stdout);
+                    if (c == 'k' || c == 'j') {
+                        adjusted = 0;
+                        params_begin(&params, &p);
+                        if (c == 'k') {
+                            if (p.mean < MEAN_MAX) p.mean += 0.1f;
+                            else p.mean = MEAN_MAX;
                         }
                         else {
-		                    printf("\r[INFO] Frequency: %.2f Hz | Amplitude: %.2f V | Mean: %.2f V                                                       ", frequency, amplitude, mean);
-		                    fflush(stdout);
+                            if (p.mean > 0.0f) p.mean -= 0.1f;
+                            else p.mean = 0.0f;
+                        }
+                        if (p.amplitude > p.mean) {
+                            p.mean = p.amplitude;
+                            adjusted = 1;
                         }
-                        pthread_mutex_unlock(&control_mutex);
+                        params_commit(&params, &p);
+                        publish_waveform();
+                        if (adjusted) status_adjusted = 1;
                     }
                 }
             }
@@ -576,86 +1095,171 @@ void* kbd_control(void* arg) {
 }
 
 
-void* toggle_switch_thread(void* arg) {
-    ///* Thread function to handle the toggle switch input for controlling the waveform type as well as stopping the program safely. */
-    unsigned char toggle_switch_value, last_switch_value = 0x00;
-    int local_mode;
+void toggle_task(void* arg) {
+    ///* Poll the toggle switches and act on a change: the kill switch, or the waveform type in Hardware Control Mode. arg points to the last switch value. */
+    unsigned char toggle_switch_value;
+    unsigned char* last_switch_value = (unsigned char*)arg;
 
-    while (!stop_flag) {
-        out8(DIO_CTLREG, 0x90);
-        toggle_switch_value = in8(DIO_PORTA);
-
-        // Only act if switch state changed
-        if (toggle_switch_value != last_switch_value) {
-            last_switch_value = toggle_switch_value;
+    das_out8_shadow(DAS_SHADOW_DIO_CTL, DIO_CTLREG, 0x90);
+    toggle_switch_value = das_in8(DIO_PORTA);
+    dio_state = toggle_switch_value;
 
-            if (toggle_switch_value == 0xFF || toggle_switch_value == 0xF8) {
-            	printf("\033[2J\033[H");
-                printf("\n[Kill Switch] Activated. Shutting down...\n");
-                raise(SIGINT);
-            }
+    // Only act if switch state changed
+    if (toggle_switch_value != *last_switch_value) {
+        *last_switch_value = toggle_switch_value;
 
-            pthread_mutex_lock(&control_mutex);
-            local_mode = control_mode;
-            pthread_mutex_unlock(&control_mutex);
+        if (toggle_switch_value == 0xFF || toggle_switch_value == 0xF8) {
+            // No stdio or signals here, this can be the cyclic executive; the status and main threads print and shut down
+            status_note = "\033[2J\033[H\n[Kill Switch] Activated. Shutting down...\n";
+            kill_switch = 1;
+            stop_flag = 1;
+            return;
+        }
 
-            if (local_mode == 1) {  // Only allow waveform switching in pot mode
-                switch (toggle_switch_value) {
-                    case 0xf4:
-                        printf("\n[INFO] Switching to SQUARE WAVE\n");
-                        wave_type = SQUARE;
-                        change_waveform = 1;
-                        break;
-                    case 0xf2:
-                        printf("\n[INFO] Switching to TRIANGLE WAVE\n");
-                        wave_type = TRIANGLE;
-                        change_waveform = 1;
-                        break;
-                    case 0xf1:
-                        printf("\n[INFO] Switching to SAWTOOTH WAVE\n");
-                        wave_type = SAWTOOTH;
-                        change_waveform = 1;
-                        break;
-                    case 0xf0:
-                        printf("\n[INFO] Switching to SINE WAVE\n");
-                        wave_type = SINE;
-                        change_waveform = 1;
-                        break;
-                }
+        if (control_mode == 1) {  // Only allow waveform switching in pot mode
+            switch (toggle_switch_value) {
+                case 0xf4:
+                    status_note = "\n[INFO] Switching to SQUARE WAVE\n";
+                    set_wave_type(SQUARE);
+                    break;
+                case 0xf2:
+                    status_note = "\n[INFO] Switching to TRIANGLE WAVE\n";
+                    set_wave_type(TRIANGLE);
+                    break;
+                case 0xf1:
+                    status_note = "\n[INFO] Switching to SAWTOOTH WAVE\n";
+                    set_wave_type(SAWTOOTH);
+                    break;
+                case 0xf0:
+                    status_note = "\n[INFO] Switching to SINE WAVE\n";
+                    set_wave_type(SINE);
+                    break;
             }
         }
+    }
+}
+
+void* toggle_switch_thread(void* arg) {
+    ///* Thread function to handle the toggle switch input for controlling the waveform type as well as stopping the program safely. */
+    unsigned char last_switch_value = 0x00;
 
+    while (!stop_flag) {
+        toggle_task(&last_switch_value);
         usleep(10000);
     }
     return NULL;
 }
 
+void output_task(void* arg) {
+    ///* Cyclic executive task, every frame: write the next ready DAC frame, after dropping the DAC frames of executive frames that were skipped. arg points to the DAC frame being held. */
+    dac_frame_t* frame = (dac_frame_t*)arg;
+    unsigned long dropped = executive.late;
 
-void init_pci_das1602() {
-    ///* Function to initialize the PCI-DAS1602 device. */
-    struct pci_dev_info info;
-    int i;
+    while (dropped-- > 0) {
+        spsc_ring_pop(&sample_ring, frame);
+    }
+    if (!spsc_ring_pop(&sample_ring, frame)) {
+        underruns++;
+    }
+    write_to_dac(*frame);
+    jitter_sample(&output_jitter, executive.deadline.next_ns - executive.deadline.period_ns);
+    samples_written++;
+}
 
-    memset(&info, 0, sizeof(info));
-    if (pci_attach(0) < 0) { perror("pci_attach"); exit(EXIT_FAILURE); }
+void* cyclic_thread(void* arg) {
+    ///* Thread function for the cyclic executive: one frame per output sample, the DAC written first in every frame, the potentiometers and the toggle switches polled every few frames in frames of their own. Replaces the waveform and toggle switch threads; the potentiometer thread only applies the pot settings it posts. */
+    dac_frame_t frame;
+    unsigned char last_switch_value = 0x00;
+    wave_params_t p;
 
-    info.VendorId = 0x1307;
-    info.DeviceId = 0x01;
+    params_read(&params, &p);
+    frame = DAC_FRAME(voltage_to_dac(p.mean), voltage_to_dac(channel1_spec ? channel1_table.mean : p.mean));
 
-    if ((hdl = pci_attach_device(0, PCI_SHARE | PCI_INIT_ALL, 0, &info)) == 0) {
-        perror("pci_attach_device");
-        exit(EXIT_FAILURE);
-    }
+    das_adc_open(&pot_adc, 1);
+    das_adc_scan_start(&pot_adc, POT_CHAN_AMPLITUDE, POT_CHAN_FREQUENCY, POT_SCAN_RATE, 0);
+
+    cyclic_exec_init(&executive, SW_SAMPLE_RATE);
+    cyclic_exec_add(&executive, "dac", output_task, &frame, 1, 0, CYCLIC_DAC_BUDGET_NS);
+    cyclic_exec_add(&executive, "adc", pot_task, NULL, CYCLIC_ADC_FRAMES, 1, CYCLIC_ADC_BUDGET_NS);
+    cyclic_exec_add(&executive, "dio", toggle_task, &last_switch_value, CYCLIC_DIO_FRAMES, CYCLIC_ADC_FRAMES / 2 + 1, CYCLIC_DIO_BUDGET_NS);
+    cyclic_exec_run(&executive, &stop_flag, spin_window_us * 1000LL, late_policy);
+
+    das_adc_scan_stop(&pot_adc);
+    das_adc_close(&pot_adc);
+    return NULL;
+}
 
-    for (i = 0; i < 5; i++) {
-        badr[i] = PCI_IO_ADDR(info.CpuBaseAddress[i]);
-        iobase[i] = mmap_device_io(0x0f, badr[i]);
+
+void metrics_update() {
+    ///* Copy the counters, parameters, inputs and output timing into the shared-memory segment. Only reads what the other threads keep anyway, so publishing costs them nothing. */
+    wave_params_t p;
+    int i;
+
+    params_read(&params, &p);
+    metrics_begin(metrics);
+
+    metrics->samples = samples_written;
+    metrics->underruns = underruns;
+    if (output_mode == OUTPUT_SOFTWARE && cyclic) {
+        metrics->deadlines = executive.deadline.deadlines;
+        metrics->deadlines_missed = executive.deadline.missed;
+    }
+    else if (output_mode == OUTPUT_SOFTWARE && timer_driven) {
+        metrics->deadlines = output_ticker.ticks;
+        metrics->deadlines_missed = output_ticker.missed;
+    }
+    else if (output_mode == OUTPUT_SOFTWARE) {
+        metrics->deadlines = output_deadline.deadlines;
+        metrics->deadlines_missed = output_deadline.missed;
+    }
+#if defined(DAS_BUS_STATS)
+    metrics->bus_writes = das_bus.writes;
+    metrics->bus_reads = das_bus.reads;
+#endif
+    metrics->sample_rate = tables.sample_rate;
+
+    metrics->wave_type = p.wave_type;
+    metrics->control_mode = control_mode;
+    metrics->amplitude = p.amplitude;
+    metrics->frequency = p.frequency;
+    metrics->mean = p.mean;
+
+    metrics->adc_conversions = pot_adc.conversions;
+    metrics->adc_first = pot_adc.scan_first;
+    metrics->adc_count = pot_adc.scan_count;
+    for (i = 0; i < METRICS_ADC_CHANNELS && i < DAS_ADC_CHANNELS; i++) {
+        metrics->adc[i] = pot_adc.latest[i];
+    }
+    metrics->dio_porta = dio_state;
+
+    if (output_mode == OUTPUT_SOFTWARE) {
+        metrics->timing_samples = output_jitter.samples;
+        metrics->lateness_p50_ns = jitter_percentile(output_jitter.lateness, 0.5);
+        metrics->lateness_p90_ns = jitter_percentile(output_jitter.lateness, 0.9);
+        metrics->lateness_p99_ns = jitter_percentile(output_jitter.lateness, 0.99);
+        metrics->lateness_p999_ns = jitter_percentile(output_jitter.lateness, 0.999);
+        metrics->lateness_max_ns = output_jitter.max_lateness_ns;
+        metrics->period_error_max_ns = output_jitter.max_late_ns > output_jitter.max_early_ns ? output_jitter.max_late_ns : output_jitter.max_early_ns;
+        metrics->timing_missed = output_jitter.missed;
     }
 
-    if (ThreadCtl(_NTO_TCTL_IO, 0) == -1) {
-        perror("ThreadCtl");
-        exit(EXIT_FAILURE);
+    metrics_end(metrics);
+}
+
+void* metrics_thread(void* arg) {
+    ///* Thread function that refreshes the shared-memory metrics a few times a second, at UI priority. */
+    while (!stop_flag) {
+        metrics_update();
+        usleep(METRICS_PERIOD_US);
     }
+    return NULL;
+}
+
+
+void init_pci_das1602() {
+    ///* Function to initialize the PCI-DAS1602 device. */
+    das_attach(0);
+
     if (mlockall(MCL_CURRENT | MCL_FUTURE) == -1) {
         perror("mlockall");
         exit(EXIT_FAILURE);
@@ -663,11 +1267,124 @@ void init_pci_das1602() {
 }
 
 
+int parse_options(int argc, char* argv[]) {
+    ///* Consume the leading '-x' options and shift the positional arguments down. Returns the new argc. */
+    int i, n = 1;
+
+    for (i = 1; i < argc; i++) {
+        if (argv[i][0] != '-' || argv[i][1] == '\0' || isdigit((unsigned char)argv[i][1])) {
+            argv[n++] = argv[i];
+            continue;
+        }
+        switch (argv[i][1]) {
+            case 'p':
+                // Hardware-paced output through the DA FIFO
+                output_mode = OUTPUT_PACER;
+                frequency_limit = PACER_FREQUENCY_MAX;
+                break;
+            case 't':
+                // Software output driven by a periodic timer pulse
+                timer_driven = 1;
+                break;
+            case 'c':
+                // One cyclic executive thread for the DAC, ADC and DIO work
+                cyclic = 1;
+                break;
+            case 'a':
+                // Arbitrary waveform file, played at its own rate after '@' or as one cycle at the set frequency
+                if (i + 1 >= argc) {
+                    printf("[ERROR] -a requires a sample file\n");
+                    exit(EXIT_FAILURE);
+                }
+                awg_filename = argv[++i];
+                if (strrchr(awg_filename, '@') && (awg_rate = atof(strrchr(awg_filename, '@') + 1)) > 0.0) {
+                    *strrchr(awg_filename, '@') = '\0';
+                }
+                break;
+            case 'w':
+                // Frequency and amplitude sweep, checked once the sample rate is known
+                if (i + 1 >= argc) {
+                    printf("[ERROR] -w requires a sweep, lin|log:f0:f1:seconds[:a0:a1][:once]\n");
+                    exit(EXIT_FAILURE);
+                }
+                sweep_spec = argv[++i];
+                break;
+            case 'm':
+                // Modulation of the set waveform, checked once the sample rate is known
+                if (i + 1 >= argc) {
+                    printf("[ERROR] -m requires a modulation, am|fm|pm:modulator:depth:rate\n");
+                    exit(EXIT_FAILURE);
+                }
+                mod_spec = argv[++i];
+                break;
+            case 'd':
+                // DAC #1 waveform, checked once the sample rate is known
+                if (i + 1 >= argc) {
+                    printf("[ERROR] -d requires a DAC #1 waveform, wave:frequency:amplitude:mean:phase\n");
+                    exit(EXIT_FAILURE);
+                }
+                channel1_spec = argv[++i];
+                break;
+            case 'r':
+                // Thread scheduling file instead of rt_threads.conf
+                if (i + 1 >= argc) {
+                    printf("[ERROR] -r requires a thread configuration file\n");
+                    exit(EXIT_FAILURE);
+                }
+                thread_file = argv[++i];
+                break;
+            case 's':
+                // Busy-wait window before each output deadline, in microseconds
+                if (i + 1 >= argc || (spin_window_us = atoi(argv[++i])) < 0) {
+                    printf("[ERROR] -s requires a spin window in microseconds\n");
+                    exit(EXIT_FAILURE);
+                }
+                break;
+            case 'l':
+                // What to do when an output deadline has already passed
+                if (i + 1 < argc && !strcmp(argv[i + 1], "skip")) late_policy = RT_LATE_SKIP;
+                else if (i + 1 < argc && !strcmp(argv[i + 1], "catchup")) late_policy = RT_LATE_CATCHUP;
+                else {
+                    printf("[ERROR] -l requires 'skip' or 'catchup'\n");
+                    exit(EXIT_FAILURE);
+                }
+                i++;
+                break;
+            default:
+                printf("[ERROR] Unknown option %s\n", argv[i]);
+                printf("Usage: %s [-p | -t | -c] [-a samples.u16|samples.f32[@rate]] [-w lin|log:f0:f1:seconds[:a0:a1][:once] | -m am|fm|pm:modulator:depth:rate] [-d wave:frequency:amplitude:mean:phase] [-r threads.conf] [-s spin_us] [-l skip|catchup] [waveform frequency amplitude mean]\n", argv[0]);
+                exit(EXIT_FAILURE);
+        }
+    }
+    argv[n] = NULL;
+    return n;
+}
+
 int main(int argc, char* argv[]) {
     ///* Main function to initialize the PCI-DAS1602 device and start the threads for waveform generation, Hardware control, keyboard control, and toggle switch handling. */
     char mode;
     struct sigaction sa;
     char user_input;
+    double rate;
+#if defined(DAS_BUS_STATS)
+    double seconds;
+    int64_t start_ns;
+#endif
+    wave_table_t* table;
+    wave_params_t p = { DEFAULT_WAVE_TYPE, DEFAULT_AMPLITUDE, DEFAULT_FREQUENCY, DEFAULT_MEAN };
+
+    argc = parse_options(argc, argv);
+    if (sweep_spec && mod_spec) {
+        // Both would drive the carrier's frequency
+        printf("[ERROR] -w and -m cannot be combined\n");
+        exit(EXIT_FAILURE);
+    }
+    if (cyclic && (output_mode == OUTPUT_PACER || timer_driven)) {
+        // The executive paces itself on deadlines; the pacer and the timer pulse have their own output threads
+        printf("[INFO] -c only applies to deadline-paced software output, ignoring it\n");
+        cyclic = 0;
+    }
+
     printf("\033[2J\033[H"); // Clear terminal
     printf("===========================================================\n");
     printf("            Welcome to the PCI-DAS1602 Controller!         \n");
@@ -676,7 +1393,7 @@ int main(int argc, char* argv[]) {
     printf(" using the PCI-DAS1602 Data Acquisition Card.\n");
     printf("\n");
     printf(" Features:\n");
-    printf("  - Output waveforms via DAC (Sine, Square, Triangle, Sawtooth)\n");
+    printf("  - Output waveforms via DAC (Sine, Square, Triangle, Sawtooth, Pulse, Cardiac)\n");
     printf("  - Real-time control of frequency and amplitude\n");
     printf("  - Multiple control modes:\n");
     printf("     [k] Keyboard Mode        Use arrow keys & number keys\n");
@@ -703,39 +1420,45 @@ int main(int argc, char* argv[]) {
 	    if (argc == 5) {
 		    char *waveform;
 		    waveform = argv[1];
-		    if (strcmp(waveform, "sine") && strcmp(waveform, "square") && strcmp(waveform, "triangle") && strcmp(waveform, "sawtooth")) {
+		    if (strcmp(waveform, "sine") && strcmp(waveform, "square") && strcmp(waveform, "triangle") && strcmp(waveform, "sawtooth") && strcmp(waveform, "pulse") && strcmp(waveform, "cardiac")) {
 		        printf("[ERROR] The waveform you selected is invalid\n");
-		        wave_type = DEFAULT_WAVE_TYPE;
+		        p.wave_type = DEFAULT_WAVE_TYPE;
 		        empty_file = 1;
 		    }
 		    if (!strcmp(waveform, "sine")) {
-		        wave_type = SINE;
+		        p.wave_type = SINE;
 		    }
 		    else if (!strcmp(waveform, "square")) {
-		        wave_type = SQUARE;
+		        p.wave_type = SQUARE;
 		    }
 		    else if (!strcmp(waveform, "triangle")) {
-		        wave_type = TRIANGLE;
+		        p.wave_type = TRIANGLE;
 		    }
 		    else if (!strcmp(waveform, "sawtooth")) {
-		        wave_type = SAWTOOTH;
+		        p.wave_type = SAWTOOTH;
+		    }
+		    else if (!strcmp(waveform, "pulse")) {
+		        p.wave_type = PULSE;
+		    }
+		    else if (!strcmp(waveform, "cardiac")) {
+		        p.wave_type = CARDIAC;
 		    }
-		    frequency = strtof(argv[2], NULL);
-		    if (frequency < FREQUENCY_MIN || frequency > FREQUENCY_MAX) {
+		    p.frequency = strtof(argv[2], NULL);
+		    if (p.frequency < FREQUENCY_MIN || p.frequency > frequency_limit) {
 		        printf("[ERROR] The frequency you selected is invalid\n");
-		        frequency = DEFAULT_FREQUENCY;
+		        p.frequency = DEFAULT_FREQUENCY;
 		        empty_file = 1;
 		    }
-		    amplitude = strtof(argv[3], NULL);
-		    if (amplitude < AMPLITUDE_MIN || amplitude > AMPLITUDE_MAX) {
+		    p.amplitude = strtof(argv[3], NULL);
+		    if (p.amplitude < AMPLITUDE_MIN || p.amplitude > AMPLITUDE_MAX) {
 		        printf("[ERROR] The amplitude you selected is invalid\n");
-		        amplitude = DEFAULT_AMPLITUDE;
+		        p.amplitude = DEFAULT_AMPLITUDE;
 		        empty_file = 1;
 		    }
-		    mean = strtof(argv[4], NULL);
-	        if (mean < MEAN_MIN || mean > MEAN_MAX || amplitude > mean) {
+		    p.mean = strtof(argv[4], NULL);
+	        if (p.mean < MEAN_MIN || p.mean > MEAN_MAX || p.amplitude > p.mean) {
 	            printf("[ERROR] The mean saved is invalid\n");
-	            mean = DEFAULT_MEAN;
+	            p.mean = DEFAULT_MEAN;
 	            empty_file = 1;
 	        }
 	    }
@@ -745,7 +1468,7 @@ int main(int argc, char* argv[]) {
 	    		while (1){
 		    		scanf(" %c", &user_input);
 		    		if (user_input == 'y' || user_input == 'Y') {
-		    			read_settings(SETTING_FILE, &amplitude, &frequency, &mean);
+		    			read_settings(SETTING_FILE, &p);
 		    			break;
 		    		}
 		    		else if (user_input == 'n' || user_input == 'N') {
@@ -761,6 +1484,17 @@ int main(int argc, char* argv[]) {
 	    delay(500);
     }
 
+    if (awg_filename) {
+        // Files ending in .f32 hold float volts, anything else 16-bit DAC codes
+        if (awg_open(&awg, awg_filename, (strlen(awg_filename) > 4 && !strcmp(awg_filename + strlen(awg_filename) - 4, ".f32")) ? AWG_VOLTS : AWG_CODES, awg_rate) == -1) {
+            perror(awg_filename);
+            exit(EXIT_FAILURE);
+        }
+        p.wave_type = ARBITRARY;
+        if (awg_rate > 0.0) printf("[INFO] Playing %s: %llu samples at %.1f samples/s\n", awg_filename, (unsigned long long)awg.samples, awg_rate);
+        else printf("[INFO] Playing %s: %llu samples as one cycle\n", awg_filename, (unsigned long long)awg.samples);
+    }
+
     printf("[INFO] Initializing PCI-DAS1602 device...\n");
 
     sa.sa_handler = sigint_handler;
@@ -769,23 +1503,140 @@ int main(int argc, char* argv[]) {
     sigaction(SIGINT, &sa, NULL);
 
     init_pci_das1602();
+    if (rt_thread_config_load(thread_file ? thread_file : RT_THREAD_FILE, thread_attr, THREAD_COUNT) == -1 && thread_file) {
+        perror(thread_file);
+        exit(EXIT_FAILURE);
+    }
+    dds_init();
+    mod_init();
+    rate = (output_mode == OUTPUT_PACER) ? pacer_rate(PACER_SAMPLE_RATE) : SW_SAMPLE_RATE;
+    params_init(&params, &p);
+    table = wave_tables_init(&tables, rate, p.wave_type, p.amplitude, p.frequency, p.mean);
+    if (sweep_spec) {
+        if (sweep_setup(sweep_spec, &p, rate) == -1) {
+            printf("[ERROR] Invalid sweep %s, expected lin|log:f0:f1:seconds[:a0:a1][:once] within %.1f-%.1f Hz and %.1f-%.1f V\n",
+                   sweep_spec, FREQUENCY_MIN, frequency_limit, AMPLITUDE_MIN, AMPLITUDE_MAX);
+            das_detach();
+            exit(EXIT_FAILURE);
+        }
+        sweep_on = 1;
+        printf("[INFO] Sweeping %s\n", sweep_spec);
+    }
+    if (channel1_spec) {
+        if (channel1_setup(channel1_spec, rate) == -1) {
+            printf("[ERROR] Invalid DAC #1 waveform %s, expected wave:frequency:amplitude:mean:phase with frequency 0 (locked) or %.1f-%.1f Hz\n",
+                   channel1_spec, FREQUENCY_MIN, frequency_limit);
+            das_detach();
+            exit(EXIT_FAILURE);
+        }
+        printf("[INFO] DAC #1: %s\n", channel1_spec);
+    }
+    if (mod_spec) {
+        if (mod_parse(mod_spec, rate) == -1) {
+            printf("[ERROR] Invalid modulation %s, expected am|fm|pm:modulator:depth:rate with depth 0-1 (am), up to %.1f Hz (fm) or pi (pm)\n",
+                   mod_spec, frequency_limit);
+            das_detach();
+            exit(EXIT_FAILURE);
+        }
+        mod_on = 1;
+        printf("[INFO] Modulating %s\n", mod_spec);
+    }
 
     printf("[INFO] Device initialized successfully.\n");
     printf("[INFO] Starting waveform, potentiometer, keyboard and kill switch threads...\n");
 
-    pthread_create(&wave_thread, NULL, waveform_thread, NULL);
-    pthread_create(&pot_thread, NULL, potentiometer_thread, NULL);
-    pthread_create(&kbd_thread, NULL, kbd_control, NULL);
-    pthread_create(&toggle_thread, NULL, toggle_switch_thread, NULL); 	
+    // The producer renders ahead; the output thread outranks it so it is never held up by rendering
+    spsc_ring_init(&sample_ring);
+    if (output_mode == OUTPUT_SOFTWARE) {
+        jitter_init(&output_jitter, (int64_t)(1e9 / SW_SAMPLE_RATE));
+    }
+#if defined(DAS_BUS_STATS)
+    start_ns = rt_now_ns();
+#endif
+    rt_thread_create(&producer_thread, &thread_attr[THREAD_PRODUCER], sample_producer_thread, table);
+    if (output_mode == OUTPUT_PACER) {
+        printf("[INFO] Hardware-paced output through the DA FIFO (up to %.0f Hz)\n", frequency_limit);
+        rt_thread_create(&wave_thread, &thread_attr[THREAD_OUTPUT], pacer_waveform_thread, NULL);
+    }
+    else if (cyclic) {
+        // DAC, potentiometers and toggle switches all run from the one executive thread
+        printf("[INFO] Cyclic executive: DAC every frame, ADC every %d, DIO every %d\n", CYCLIC_ADC_FRAMES, CYCLIC_DIO_FRAMES);
+        rt_thread_create(&wave_thread, &thread_attr[THREAD_OUTPUT], cyclic_thread, NULL);
+    }
+    else {
+        rt_thread_create(&wave_thread, &thread_attr[THREAD_OUTPUT], waveform_thread, NULL);
+    }
+    rt_thread_create(&pot_thread, &thread_attr[THREAD_POT], potentiometer_thread, NULL);
+    if (!cyclic) {
+        rt_thread_create(&toggle_thread, &thread_attr[THREAD_TOGGLE], toggle_switch_thread, NULL);
+    }
+    rt_thread_create(&kbd_thread, &thread_attr[THREAD_KEYBOARD], kbd_control, NULL);
+    rt_thread_create(&status_tid, &thread_attr[THREAD_STATUS], status_thread, NULL);
+    if ((metrics = metrics_create()) != NULL) {
+        rt_thread_create(&metrics_tid, &thread_attr[THREAD_METRICS], metrics_thread, NULL);
+    }
+    else {
+        perror("[INFO] No shared-memory metrics: shm_open");
+    }
 
     pthread_join(wave_thread, NULL);
+    pthread_join(producer_thread, NULL);
     pthread_join(pot_thread, NULL);
+    if (!cyclic) {
+        pthread_join(toggle_thread, NULL);
+    }
     pthread_join(kbd_thread, NULL);
-    pthread_join(toggle_thread, NULL);
+    pthread_join(status_tid, NULL);
+    if (metrics) {
+        pthread_join(metrics_tid, NULL);
+        metrics_update();
+        metrics_destroy(metrics);
+    }
+    if (kill_switch) {
+        save_prompt();
+    }
 
     printf("\n[INFO] All threads closed. Cleaning up resources...\n");
+    printf("[INFO] Output underruns: %lu\n", underruns);
+    if (cyclic) {
+        cyclic_exec_report(&executive);
+    }
+    else if (output_mode == OUTPUT_SOFTWARE && timer_driven) {
+        printf("[INFO] Output timer ticks: %lu, overruns: %lu, skipped: %lu\n", output_ticker.ticks, output_ticker.missed, output_ticker.skipped);
+    }
+    else if (output_mode == OUTPUT_SOFTWARE) {
+        printf("[INFO] Output deadlines: %lu, missed: %lu, skipped: %lu\n", output_deadline.deadlines, output_deadline.missed, output_deadline.skipped);
+    }
+    if (output_mode == OUTPUT_SOFTWARE) {
+        jitter_report(&output_jitter);
+        if (samples_written > 0) {
+            printf("[INFO] DAC #0 to #1 skew: mean %.0f ns, max %.0f ns\n", (double)skew_cycles_total / samples_written * output_jitter.ns_per_cycle,
+                   skew_cycles_max * output_jitter.ns_per_cycle);
+        }
+    }
+    else {
+        printf("[INFO] DAC #0 to #1 skew: one pacer scan step, set by the board\n");
+    }
+#if defined(DAS_BUS_STATS)
+    seconds = (rt_now_ns() - start_ns) / 1e9;
+    printf("[INFO] Bus writes: %lu (%.0f/s), reads: %lu (%.0f/s), unchanged writes skipped: %lu\n",
+           das_bus.writes, das_bus.writes / seconds, das_bus.reads, das_bus.reads / seconds, das_bus.skipped);
+#endif
+    if (pot_adc.conversions > 0) {
+        printf("[INFO] ADC conversions: %lu (%.0f scans/s), block reads: %lu, interrupts: %lu, timeouts: %lu\n", pot_adc.conversions, pot_adc.scan_rate,
+               pot_adc.blocks, pot_adc.interrupts, pot_adc.timeouts);
+    }
+#if defined(DAS_BUS_STATS)
+    if (samples_written > 0) {
+        printf("[INFO] Bus traffic per sample: %.2f writes, %.2f reads\n", (double)das_bus.writes / samples_written, (double)das_bus.reads / samples_written);
+    }
+#endif
 
-    pci_detach_device(hdl);
+    if (awg_filename) {
+        printf("[INFO] Arbitrary waveform file windows mapped: %lu, late in the producer: %lu\n", awg.remaps + awg.late_remaps, awg.late_remaps);
+        awg_close(&awg);
+    }
+    das_detach();
 
     printf("==== Program exited cleanly. Goodbye! ====\n");
     return 0;
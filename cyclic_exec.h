@@ -0,0 +1,134 @@
+// Multi-rate cyclic executive
+//
+// One thread runs every periodic job of the program from a fixed table. Time
+// is cut into minor frames of one sample period, each started on an absolute
+// rt_deadline_t. A task runs once every 'period' frames, in frame 'offset' of
+// its period, so slow jobs can be spread over different frames and never land
+// together on top of the fast one. Tasks run in the order they were added, so
+// the one added first (the DAC write) always goes out first in its frame.
+//
+// Every run is timed against the task's budget. A run over budget counts as
+// an overrun for that task; a frame whose tasks together ran past the frame
+// length counts as a frame overrun. Frames dropped by RT_LATE_SKIP still
+// advance the frame counter, and a task whose frame was dropped runs in the
+// next frame instead, so slow tasks keep their rate. 'late' holds the frames
+// dropped before the current one, for a task that has to stay in phase.
+//
+// Tasks must not block: they poll hardware, move data and return.
+
+#ifndef CYCLIC_EXEC_H
+#define CYCLIC_EXEC_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <signal.h>
+#include "rt_timing.h"
+
+#define CYCLIC_MAX_TASKS	8
+
+typedef void (*cyclic_fn_t)(void* arg);
+
+typedef struct {
+    const char* name;
+    cyclic_fn_t fn;
+    void* arg;
+    unsigned period;			// minor frames between runs
+    unsigned offset;			// frame within the period the task runs in
+    int64_t budget_ns;			// longest a run may take
+    uint64_t next;				// frame of the next run
+    unsigned long runs;
+    unsigned long overruns;		// runs longer than budget_ns
+    int64_t worst_ns;
+    int64_t total_ns;
+} cyclic_task_t;
+
+typedef struct {
+    rt_deadline_t deadline;		// start of each minor frame
+    double frame_rate;			// minor frames per second
+    cyclic_task_t task[CYCLIC_MAX_TASKS];
+    int tasks;
+    uint64_t frame;				// minor frames elapsed, dropped ones included
+    unsigned long late;			// frames dropped just before the current one
+    unsigned long frame_overruns;	// frames whose tasks ran past the frame length
+    int64_t worst_frame_ns;
+} cyclic_exec_t;
+
+static inline void cyclic_exec_init(cyclic_exec_t* exec, double frame_rate) {
+    memset(exec, 0, sizeof(*exec));
+    exec->frame_rate = frame_rate;
+}
+
+static inline int cyclic_exec_add(cyclic_exec_t* exec, const char* name, cyclic_fn_t fn, void* arg, unsigned period, unsigned offset, int64_t budget_ns) {
+    // Run fn every 'period' frames, in frame 'offset' of the period. Returns -1 if the table is full.
+    cyclic_task_t* task;
+
+    if (exec->tasks >= CYCLIC_MAX_TASKS || period == 0) {
+        return -1;
+    }
+    task = &exec->task[exec->tasks++];
+    memset(task, 0, sizeof(*task));
+    task->name = name;
+    task->fn = fn;
+    task->arg = arg;
+    task->period = period;
+    task->offset = offset % period;
+    task->budget_ns = budget_ns;
+    task->next = task->offset;
+    return 0;
+}
+
+static inline void cyclic_exec_frame(cyclic_exec_t* exec) {
+    // Run every task due in the current frame
+    cyclic_task_t* task;
+    int64_t start, end, frame_start = rt_now_ns();
+    int i;
+
+    for (i = 0; i < exec->tasks; i++) {
+        task = &exec->task[i];
+        if (exec->frame < task->next) continue;
+
+        start = rt_now_ns();
+        task->fn(task->arg);
+        end = rt_now_ns();
+
+        task->runs++;
+        task->total_ns += end - start;
+        if (end - start > task->worst_ns) task->worst_ns = end - start;
+        if (end - start > task->budget_ns) task->overruns++;
+
+        // Back onto the task's own grid, past any frames that were dropped
+        while (task->next <= exec->frame) task->next += task->period;
+    }
+
+    end = rt_now_ns() - frame_start;
+    if (end > exec->worst_frame_ns) exec->worst_frame_ns = end;
+    if (end > exec->deadline.period_ns) exec->frame_overruns++;
+}
+
+static inline void cyclic_exec_run(cyclic_exec_t* exec, volatile sig_atomic_t* stop, int64_t spin_ns, int policy) {
+    // Run frames until *stop is set
+    rt_deadline_start(&exec->deadline, exec->frame_rate, spin_ns, policy);
+
+    while (!*stop) {
+        cyclic_exec_frame(exec);
+        exec->late = rt_deadline_wait(&exec->deadline);
+        exec->frame += 1 + exec->late;
+    }
+}
+
+static inline void cyclic_exec_report(const cyclic_exec_t* exec) {
+    const cyclic_task_t* task;
+    int i;
+
+    printf("[INFO] Cyclic executive: %llu frames at %.0f Hz, deadlines missed: %lu, frame overruns: %lu, worst frame: %.1f us\n",
+           (unsigned long long)exec->frame, exec->frame_rate, exec->deadline.missed, exec->frame_overruns, exec->worst_frame_ns / 1e3);
+    for (i = 0; i < exec->tasks; i++) {
+        task = &exec->task[i];
+        printf("[INFO]   %-8s every %u frame(s): %lu runs, mean %.1f us, worst %.1f us, budget %.1f us, overruns: %lu\n",
+               task->name, task->period, task->runs, task->runs ? task->total_ns / 1e3 / task->runs : 0.0,
+               task->worst_ns / 1e3, task->budget_ns / 1e3, task->overruns);
+    }
+}
+
+#endif
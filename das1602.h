@@ -0,0 +1,711 @@
+// Register access layer for the PCI-DAS1602/16
+//
+// Every program in this project talks to the card through the functions here
+// instead of calling out16()/in16()/in8() directly. On QNX they are static
+// inline wrappers that compile straight to the port instructions, so there is
+// no cost over the raw calls. Anywhere else the same calls drive a simulated
+// card, so the programs build and run on a plain Linux box and timing or
+// throughput changes can be measured without the hardware. The exception is
+// main.c, an unfinished early draft that does not compile on either target.
+//
+// The simulation models:
+//   - DAC #0/#1: software updates, channel scan and the DA FIFO, which the
+//     pacer drains in real time at the rate programmed into the 8254
+//   - ADC: MUX/channel range, software start, the conversion-done status bit
+//     (0x4000 in MUXCHAN) and the AD FIFO
+//   - DIO: 8255 ports A, B and C
+//   - both 8254s (TIMER0-2 and PACER1-3): control words and divisors; a counter
+//     stops at its control word and runs again once its divisor is loaded
+//
+// Simulation inputs come from the environment:
+//   DAS_SIM_ADC    comma separated 16-bit readings for channels 0, 1, ... (default 0x8000)
+//   DAS_SIM_DIO    value read back from DIO port A (default 0xf0, all switches off)
+//   DAS_SIM_TRACE  file that receives one "time_ns channel code" line per DAC update
+
+#ifndef DAS1602_H
+#define DAS1602_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include "rt_atomic.h"
+#if defined(__QNX__)
+    #include <hw/pci.h>
+    #include <hw/inout.h>
+    #include <sys/neutrino.h>
+    #include <sys/mman.h>
+#else
+    #include <ctype.h>
+    #include <pthread.h>
+    #include <time.h>
+    #include <unistd.h>
+#endif
+
+#define	INTERRUPT	iobase[1] + 0		// Badr1 + 0 : also ADC register
+#define	MUXCHAN		iobase[1] + 2		// Badr1 + 2
+#define	TRIGGER		iobase[1] + 4		// Badr1 + 4
+#define	AUTOCAL		iobase[1] + 6		// Badr1 + 6
+#define DA_CTLREG	iobase[1] + 8		// Badr1 + 8
+
+#define	AD_DATA		iobase[2] + 0		// Badr2 + 0
+#define	AD_FIFOCLR	iobase[2] + 2		// Badr2 + 2
+
+#define	TIMER0		iobase[3] + 0		// Badr3 + 0
+#define	TIMER1		iobase[3] + 1		// Badr3 + 1
+#define	TIMER2		iobase[3] + 2		// Badr3 + 2
+#define	COUNTCTL	iobase[3] + 3		// Badr3 + 3
+#define	DIO_PORTA	iobase[3] + 4		// Badr3 + 4
+#define	DIO_PORTB	iobase[3] + 5		// Badr3 + 5
+#define	DIO_PORTC	iobase[3] + 6		// Badr3 + 6
+#define	DIO_CTLREG	iobase[3] + 7		// Badr3 + 7
+#define	PACER1		iobase[3] + 8		// Badr3 + 8
+#define	PACER2		iobase[3] + 9		// Badr3 + 9
+#define	PACER3		iobase[3] + 0xa		// Badr3 + a
+#define	PACERCTL	iobase[3] + 0xb		// Badr3 + b
+
+#define DA_Data		iobase[4] + 0		// Badr4 + 0
+#define	DA_FIFOCLR	iobase[4] + 2		// Badr4 + 2
+
+// DA_CTLREG control words
+#define DAC_CTL_SW_CH0		0x0a23		// DA Enable, #0, SW 5V unipolar
+#define DAC_CTL_SW_CH1		0x0a43		// DA Enable, #1, SW 5V unipolar
+#define DAC_CTL_SW_SCAN		0x0a63		// DA Enable, #0-#1 scan, SW 5V unipolar: data writes alternate #0, #1
+#define DAC_CTL_PACER_SCAN	0x0a67		// DA Enable, #0-#1 scan, internal pacer, 5V unipolar
+#define DAC_CTL_PACER_MASK	0x000c		// DA pacer source: 00 SW, 01 internal pacer
+#define DAC_CTL_PACER_INT	0x0004
+#define DAC_CTL_CH_MASK		0x0060		// DA channel select: #0, #1 or #0-#1 scan
+#define DAC_STAT_HALF_EMPTY	0x0400		// INTERRUPT read : DA FIFO half empty
+
+#define ADC_STAT_EOC		0x4000		// MUXCHAN read : conversion done, data in AD FIFO
+
+// INTERRUPT write : ADC interrupt control
+#define ADC_INT_SEL_EOC		0x0001		// INTSEL : interrupt at the end of each conversion
+#define ADC_INT_SEL_HALF	0x0002		// INTSEL : interrupt when the AD FIFO reaches half full
+#define ADC_INT_SEL_MASK	0x0003
+#define ADC_INT_ENABLE		0x0004		// INTE : ADC interrupt enable
+#define ADC_INT_CLEAR		0x0080		// INTCL : acknowledge a latched ADC interrupt
+#define INT_CLEAR_ALL		0x60c0		// clear every latched interrupt, all sources disabled
+#define ADC_STAT_HALF_FULL	0x0200		// INTERRUPT read : AD FIFO half full
+
+// MUXCHAN write : bits 0-3 first channel, bits 4-7 last channel
+#define ADC_MUX_SE_UNI_5V	0x0D00		// single ended, unipolar, 5V, conversions started by software
+#define ADC_MUX_PACER_INT	0x1000		// ADPS : conversions clocked by the TIMER 8254 (counters 1-2)
+
+// TRIGGER write
+#define ADC_TRIG_DEFAULT	0x2081		// 10MHz, clear, burst off, SW trigger
+#define ADC_TRIG_BURST		0x0008		// BURSTE : each pacer tick converts the whole channel range
+
+// 8254 control words (counter, LSB then MSB, mode 2 rate generator, binary),
+// for both the PACER (DAC) and the TIMER (ADC) chip
+#define PACER_CTR1_MODE2	0x74
+#define PACER_CTR2_MODE2	0xb4
+
+#define PACER_CLOCK_HZ		10000000.0	// 8254 time base
+#define PACER_RATE_MAX		100000.0	// DA scans per second
+#define ADC_RATE_MAX		100000.0	// AD conversions per second
+#define DA_FIFO_SIZE		1024		// 16-bit words
+#define DA_FIFO_HALF		(DA_FIFO_SIZE / 2)
+#define AD_FIFO_SIZE		1024
+
+#define DAS_VENDOR_ID		0x1307
+#define DAS_DEVICE_ID		0x01
+
+static uintptr_t iobase[6];
+static int badr[5];
+
+#if defined(__QNX__)
+
+static void* das_hdl;
+static int das_irq = -1;	// card interrupt line, -1 when there is none
+
+static inline void das_port_out8(uintptr_t port, uint8_t val) { out8(port, val); }
+static inline void das_port_out16(uintptr_t port, uint16_t val) { out16(port, val); }
+static inline uint8_t das_port_in8(uintptr_t port) { return in8(port); }
+static inline uint16_t das_port_in16(uintptr_t port) { return in16(port); }
+static inline void das_port_out16s(uintptr_t port, const uint16_t* buf, unsigned n) { out16s(buf, n, port); }
+static inline void das_port_in16s(uintptr_t port, uint16_t* buf, unsigned n) { in16s(buf, n, port); }
+
+static inline void das_attach(int verbose) {
+    // Attach to the card, map BADR0-4 into the process and get I/O privileges. Exits on failure.
+    struct pci_dev_info info;
+    int i;
+
+    memset(&info, 0, sizeof(info));
+    if (pci_attach(0) < 0) {
+        perror("pci_attach");
+        exit(EXIT_FAILURE);
+    }
+
+    info.VendorId = DAS_VENDOR_ID;
+    info.DeviceId = DAS_DEVICE_ID;
+
+    if ((das_hdl = pci_attach_device(0, PCI_SHARE | PCI_INIT_ALL, 0, &info)) == 0) {
+        perror("pci_attach_device");
+        exit(EXIT_FAILURE);
+    }
+
+    if (verbose) {
+        for (i = 0; i < 6; i++) {
+            if (info.BaseAddressSize[i] > 0) {
+                printf("Aperture %d  Base 0x%x Length %d Type %s\n", i,
+                       PCI_IS_MEM(info.CpuBaseAddress[i]) ? (int)PCI_MEM_ADDR(info.CpuBaseAddress[i]) : (int)PCI_IO_ADDR(info.CpuBaseAddress[i]), info.BaseAddressSize[i],
+                       PCI_IS_MEM(info.CpuBaseAddress[i]) ? "MEM" : "IO");
+            }
+        }
+        printf("IRQ %d\n", info.Irq);
+    }
+
+    for (i = 0; i < 5; i++) {
+        badr[i] = PCI_IO_ADDR(info.CpuBaseAddress[i]);
+        iobase[i] = mmap_device_io(0x0f, badr[i]);
+        if (verbose) printf("Badr[%d] : %x  Iobase : %x\n", i, badr[i], (unsigned)iobase[i]);
+    }
+    das_irq = info.Irq;
+
+    if (ThreadCtl(_NTO_TCTL_IO, 0) == -1) {
+        perror("ThreadCtl");
+        exit(EXIT_FAILURE);
+    }
+}
+
+static inline void das_detach(void) {
+    pci_detach_device(das_hdl);
+}
+
+typedef struct {
+    struct sigevent event;
+    int id;						// InterruptAttachEvent() id, -1 when not attached
+} das_irq_t;
+
+static inline int das_irq_attach(das_irq_t* irq) {
+    // Route the card's IRQ to the calling thread, which alone may then das_irq_wait(). Returns -1 if there is none.
+    irq->id = -1;
+    if (das_irq < 0) {
+        return -1;
+    }
+    SIGEV_INTR_INIT(&irq->event);
+    if ((irq->id = InterruptAttachEvent(das_irq, &irq->event, _NTO_INTR_FLAGS_TRK_MSK)) == -1) {
+        perror("InterruptAttachEvent");
+        return -1;
+    }
+    return 0;
+}
+
+static inline int das_irq_wait(das_irq_t* irq, int64_t timeout_ns) {
+    // Sleep until the IRQ fires. Returns -1 on timeout. The line stays masked until das_irq_unmask().
+    uint64_t ns = (uint64_t)timeout_ns;
+
+    TimerTimeout(CLOCK_MONOTONIC, _NTO_TIMEOUT_INTR, NULL, &ns, NULL);
+    return (InterruptWait(0, NULL) == -1) ? -1 : 0;
+}
+
+static inline void das_irq_unmask(das_irq_t* irq) {
+    InterruptUnmask(das_irq, irq->id);
+}
+
+static inline void das_irq_detach(das_irq_t* irq) {
+    if (irq->id != -1) InterruptDetach(irq->id);
+    irq->id = -1;
+}
+
+#else
+
+// Simulated ports are (bar + 1) << 8 | offset, so a port number decodes back to its register
+#define DAS_SIM_PORT(bar)	((uintptr_t)((bar) + 1) << 8)
+#define DAS_SIM_BAR(port)	((int)((port) >> 8) - 1)
+#define DAS_SIM_OFF(port)	((int)((port) & 0xff))
+
+typedef struct {
+    uint16_t ctl;				// last DA_CTLREG word
+    uint16_t code[2];			// code currently on DAC #0 and #1
+    int next;					// channel the next scan word goes to
+    uint16_t fifo[DA_FIFO_SIZE];
+    unsigned head, count;
+    int64_t drained_ns;			// time the FIFO has been drained up to
+    unsigned long underflows;	// pacer ticks that found the FIFO empty
+} das_sim_dac_t;
+
+typedef struct {
+    uint8_t ctl[3];				// control word per counter
+    uint16_t div[3];			// divisor per counter, 0 = 65536
+    uint16_t load[3];			// LSB held while waiting for the MSB
+    int msb_next[3];
+    int held[3];				// control word written, divisor not loaded yet: the counter is stopped
+} das_sim_8254_t;
+
+typedef struct {
+    pthread_mutex_t lock;
+    das_sim_dac_t dac;
+    das_sim_8254_t ctr[2];		// [0] TIMER0-2 / COUNTCTL, [1] PACER1-3 / PACERCTL
+    uint16_t reg1[5];			// other BADR1 words as last written
+    uint16_t mux;				// MUXCHAN as last written
+    int ad_chan;				// channel the next conversion reads
+    uint16_t ad_fifo[AD_FIFO_SIZE];
+    unsigned ad_head, ad_count;
+    uint16_t ad_last;
+    int64_t ad_ticked_ns;		// time the ADC pacer has been run up to
+    uint16_t adc_input[16];
+    int irq_pending;			// ADC interrupt latched and not yet acknowledged
+    pthread_cond_t irq_cond;
+    uint8_t dio[3];				// port A input, ports B/C as last written
+    uint8_t dio_ctl;
+    FILE* trace;
+} das_sim_t;
+
+static das_sim_t das_sim = { .lock = PTHREAD_MUTEX_INITIALIZER };
+
+static inline int64_t das_sim_now_ns(void) {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+static inline void das_sim_dac_set(int ch, uint16_t code, int64_t t_ns) {
+    das_sim.dac.code[ch] = code;
+    if (das_sim.trace) fprintf(das_sim.trace, "%lld %d %u\n", (long long)t_ns, ch, code);
+}
+
+static inline int das_sim_first_chan(uint16_t ctl) {
+    return ((ctl & DAC_CTL_CH_MASK) == 0x40) ? 1 : 0;
+}
+
+static inline int das_sim_next_chan(uint16_t ctl, int ch) {
+    // Scan alternates #0 and #1, a single channel stays put
+    return ((ctl & DAC_CTL_CH_MASK) == DAC_CTL_CH_MASK) ? !ch : ch;
+}
+
+static inline double das_sim_8254_rate(const das_sim_8254_t* c) {
+    // Ticks per second out of cascaded counters 1 and 2
+    double d1 = c->div[1] ? c->div[1] : 65536.0;
+    double d2 = c->div[2] ? c->div[2] : 65536.0;
+
+    return PACER_CLOCK_HZ / (d1 * d2);
+}
+
+static inline int das_sim_8254_running(const das_sim_8254_t* c) {
+    return !c->held[1] && !c->held[2];
+}
+
+static inline void das_sim_drain(void) {
+    // Play the DA FIFO out at the pacer rate up to now
+    das_sim_dac_t* dac = &das_sim.dac;
+    int64_t now = das_sim_now_ns(), period, t;
+    int ch, w, words;
+
+    if ((dac->ctl & DAC_CTL_PACER_MASK) != DAC_CTL_PACER_INT || !das_sim_8254_running(&das_sim.ctr[1])) {
+        dac->drained_ns = now;
+        return;
+    }
+    period = (int64_t)(1e9 / das_sim_8254_rate(&das_sim.ctr[1]));
+    if (period < 1) period = 1;
+    words = ((dac->ctl & DAC_CTL_CH_MASK) == DAC_CTL_CH_MASK) ? 2 : 1;
+
+    for (t = dac->drained_ns + period; t <= now; t += period) {
+        if (dac->count == 0) {
+            // Every remaining tick up to now finds the FIFO empty
+            dac->underflows += (unsigned long)((now - t) / period) + 1;
+            t += (now - t) / period * period;
+            dac->drained_ns = t;
+            break;
+        }
+        ch = das_sim_first_chan(dac->ctl);
+        for (w = 0; w < words && dac->count > 0; w++) {
+            das_sim_dac_set(ch, dac->fifo[dac->head], t);
+            dac->head = (dac->head + 1) % DA_FIFO_SIZE;
+            dac->count--;
+            ch = das_sim_next_chan(dac->ctl, ch);
+        }
+        dac->drained_ns = t;
+    }
+}
+
+static inline void das_sim_convert(void) {
+    // One conversion of the current channel into the AD FIFO, then step the scan and raise the ADC interrupt if enabled
+    uint16_t intr = das_sim.reg1[0];
+
+    if (das_sim.ad_count < AD_FIFO_SIZE) {
+        das_sim.ad_fifo[(das_sim.ad_head + das_sim.ad_count++) % AD_FIFO_SIZE] = das_sim.adc_input[das_sim.ad_chan];
+    }
+    das_sim.ad_chan = (das_sim.ad_chan >= ((das_sim.mux >> 4) & 0x0f)) ? (das_sim.mux & 0x0f) : das_sim.ad_chan + 1;
+
+    if ((intr & ADC_INT_ENABLE) &&
+        ((intr & ADC_INT_SEL_MASK) == ADC_INT_SEL_EOC || ((intr & ADC_INT_SEL_MASK) == ADC_INT_SEL_HALF && das_sim.ad_count >= AD_FIFO_SIZE / 2))) {
+        das_sim.irq_pending = 1;
+        pthread_cond_broadcast(&das_sim.irq_cond);
+    }
+}
+
+static inline void das_sim_adc_run(void) {
+    // Conversions clocked by the ADC pacer up to now: one per tick, or the whole channel range per tick in burst mode
+    int64_t now = das_sim_now_ns(), period, ticks;
+    int n, per_tick;
+
+    if (!(das_sim.mux & ADC_MUX_PACER_INT) || !das_sim_8254_running(&das_sim.ctr[0])) {
+        das_sim.ad_ticked_ns = now;
+        return;
+    }
+    period = (int64_t)(1e9 / das_sim_8254_rate(&das_sim.ctr[0]));
+    if (period < 1) period = 1;
+    ticks = (now - das_sim.ad_ticked_ns) / period;
+    das_sim.ad_ticked_ns += ticks * period;
+
+    per_tick = (das_sim.reg1[2] & ADC_TRIG_BURST) ? ((das_sim.mux >> 4) & 0x0f) - (das_sim.mux & 0x0f) + 1 : 1;
+    if (per_tick < 1) per_tick = 1;
+    if (ticks > AD_FIFO_SIZE) ticks = AD_FIFO_SIZE;		// a full FIFO drops the rest anyway
+    for (n = (int)ticks * per_tick; n > 0; n--) {
+        das_sim_convert();
+    }
+}
+
+static inline void das_sim_8254_write(das_sim_8254_t* c, int off, uint8_t val) {
+    int n;
+
+    if (off == 3) {
+        n = (val >> 6) & 3;
+        if (n < 3) {
+            c->ctl[n] = val;
+            c->msb_next[n] = 0;
+            c->held[n] = 1;
+        }
+        return;
+    }
+    if (c->msb_next[off]) {
+        c->div[off] = (uint16_t)(c->load[off] | (val << 8));
+        c->held[off] = 0;
+    }
+    else {
+        c->load[off] = val;
+    }
+    c->msb_next[off] = !c->msb_next[off];
+}
+
+static inline void das_sim_write(uintptr_t port, uint16_t val) {
+    das_sim_dac_t* dac = &das_sim.dac;
+    int off = DAS_SIM_OFF(port);
+
+    pthread_mutex_lock(&das_sim.lock);
+    switch (DAS_SIM_BAR(port)) {
+        case 1:
+            if (off == 2) {
+                das_sim.mux = val;
+                das_sim.ad_chan = val & 0x0f;
+                das_sim.ad_ticked_ns = das_sim_now_ns();
+            }
+            else if (off == 8) {
+                das_sim_drain();
+                dac->ctl = val;
+                dac->next = das_sim_first_chan(val);
+            }
+            else if (off == 0) {
+                // The clear bits are strobes, only the enables and source select stick
+                if (val & ADC_INT_CLEAR) das_sim.irq_pending = 0;
+                das_sim.reg1[0] = val & ~INT_CLEAR_ALL;
+            }
+            else if (off / 2 < 5) {
+                das_sim.reg1[off / 2] = val;
+            }
+            break;
+        case 2:
+            if (off == 0) {
+                das_sim_convert();	// software start
+            }
+            else if (off == 2) {
+                das_sim.ad_head = das_sim.ad_count = 0;
+            }
+            break;
+        case 3:
+            if (off < 4) das_sim_8254_write(&das_sim.ctr[0], off, (uint8_t)val);
+            else if (off < 7) das_sim.dio[off - 4] = (uint8_t)val;
+            else if (off == 7) das_sim.dio_ctl = (uint8_t)val;
+            else das_sim_8254_write(&das_sim.ctr[1], off - 8, (uint8_t)val);
+            break;
+        case 4:
+            das_sim_drain();
+            if (off == 2) {
+                dac->head = dac->count = 0;
+                dac->next = das_sim_first_chan(dac->ctl);
+            }
+            else if ((dac->ctl & DAC_CTL_PACER_MASK) == DAC_CTL_PACER_INT) {
+                if (dac->count < DA_FIFO_SIZE) {
+                    dac->fifo[(dac->head + dac->count++) % DA_FIFO_SIZE] = val;
+                }
+            }
+            else {
+                das_sim_dac_set(dac->next, val, das_sim_now_ns());
+                dac->next = das_sim_next_chan(dac->ctl, dac->next);
+            }
+            break;
+    }
+    pthread_mutex_unlock(&das_sim.lock);
+}
+
+static inline uint16_t das_sim_read(uintptr_t port) {
+    uint16_t val = 0;
+    int off = DAS_SIM_OFF(port);
+
+    pthread_mutex_lock(&das_sim.lock);
+    switch (DAS_SIM_BAR(port)) {
+        case 1:
+            if (off == 0) {
+                das_sim_drain();
+                das_sim_adc_run();
+                val = das_sim.reg1[0] | (das_sim.dac.count <= DA_FIFO_HALF ? DAC_STAT_HALF_EMPTY : 0)
+                    | (das_sim.ad_count >= AD_FIFO_SIZE / 2 ? ADC_STAT_HALF_FULL : 0);
+            }
+            else if (off == 2) {
+                das_sim_adc_run();
+                val = (das_sim.mux & ~ADC_STAT_EOC) | (das_sim.ad_count ? ADC_STAT_EOC : 0);
+            }
+            else if (off / 2 < 5) {
+                val = das_sim.reg1[off / 2];
+            }
+            break;
+        case 2:
+            if (off == 0) {
+                das_sim_adc_run();
+                if (das_sim.ad_count) {
+                    das_sim.ad_last = das_sim.ad_fifo[das_sim.ad_head];
+                    das_sim.ad_head = (das_sim.ad_head + 1) % AD_FIFO_SIZE;
+                    das_sim.ad_count--;
+                }
+                val = das_sim.ad_last;
+            }
+            break;
+        case 3:
+            if (off >= 4 && off < 7) val = das_sim.dio[off - 4];
+            else if (off == 7) val = das_sim.dio_ctl;
+            break;
+    }
+    pthread_mutex_unlock(&das_sim.lock);
+    return val;
+}
+
+static inline void das_port_out8(uintptr_t port, uint8_t val) { das_sim_write(port, val); }
+static inline void das_port_out16(uintptr_t port, uint16_t val) { das_sim_write(port, val); }
+static inline uint8_t das_port_in8(uintptr_t port) { return (uint8_t)das_sim_read(port); }
+static inline uint16_t das_port_in16(uintptr_t port) { return das_sim_read(port); }
+
+static inline void das_port_out16s(uintptr_t port, const uint16_t* buf, unsigned n) {
+    while (n--) das_sim_write(port, *buf++);
+}
+
+static inline void das_port_in16s(uintptr_t port, uint16_t* buf, unsigned n) {
+    while (n--) *buf++ = das_sim_read(port);
+}
+
+static inline void das_attach(int verbose) {
+    // Set up the simulated card and its inputs from the environment
+    pthread_condattr_t attr;
+    const char* env;
+    char* end;
+    int i;
+
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    pthread_cond_init(&das_sim.irq_cond, &attr);
+    pthread_condattr_destroy(&attr);
+
+    for (i = 0; i < 5; i++) {
+        badr[i] = (int)DAS_SIM_PORT(i);
+        iobase[i] = DAS_SIM_PORT(i);
+    }
+    for (i = 0; i < 16; i++) {
+        das_sim.adc_input[i] = 0x8000;
+    }
+    if ((env = getenv("DAS_SIM_ADC")) != NULL) {
+        for (i = 0; i < 16 && *env; i++) {
+            das_sim.adc_input[i] = (uint16_t)strtoul(env, &end, 0);
+            if (*end != ',') break;
+            env = end + 1;
+        }
+    }
+    das_sim.dio[0] = 0xf0;
+    if ((env = getenv("DAS_SIM_DIO")) != NULL) {
+        das_sim.dio[0] = (uint8_t)strtoul(env, NULL, 0);
+    }
+    if ((env = getenv("DAS_SIM_TRACE")) != NULL && (das_sim.trace = fopen(env, "w")) == NULL) {
+        perror("DAS_SIM_TRACE");
+    }
+    das_sim.dac.drained_ns = das_sim_now_ns();
+
+    if (verbose) {
+        printf("[INFO] No QNX PCI bus, using the simulated PCI-DAS1602\n");
+    }
+}
+
+static inline void das_detach(void) {
+    if (das_sim.trace) fclose(das_sim.trace);
+    das_sim.trace = NULL;
+}
+
+typedef struct {
+    int id;
+} das_irq_t;
+
+// The simulated ADC interrupt is a condition variable signalled by das_sim_convert()
+static inline int das_irq_attach(das_irq_t* irq) {
+    irq->id = 0;
+    return 0;
+}
+
+static inline int das_irq_wait(das_irq_t* irq, int64_t timeout_ns) {
+    struct timespec ts;
+    int64_t t = das_sim_now_ns() + timeout_ns;
+    int rc = 0;
+
+    (void)irq;
+    ts.tv_sec = t / 1000000000LL;
+    ts.tv_nsec = t % 1000000000LL;
+    pthread_mutex_lock(&das_sim.lock);
+    for (;;) {
+        das_sim_adc_run();
+        if (das_sim.irq_pending || rc != 0) break;
+        if (das_sim.mux & ADC_MUX_PACER_INT) {
+            // Paced conversions only happen when the simulation runs, so look again every 100 us
+            pthread_mutex_unlock(&das_sim.lock);
+            usleep(100);
+            pthread_mutex_lock(&das_sim.lock);
+            rc = das_sim_now_ns() >= t;
+        }
+        else {
+            rc = pthread_cond_timedwait(&das_sim.irq_cond, &das_sim.lock, &ts);
+        }
+    }
+    rc = das_sim.irq_pending ? 0 : -1;
+    pthread_mutex_unlock(&das_sim.lock);
+    return rc;
+}
+
+static inline void das_irq_unmask(das_irq_t* irq) {
+    (void)irq;
+}
+
+static inline void das_irq_detach(das_irq_t* irq) {
+    irq->id = -1;
+}
+
+// QNX library calls the programs use outside the card access
+static inline unsigned delay(unsigned ms) {
+    usleep(ms * 1000);
+    return 0;
+}
+
+static inline char* strlwr(char* s) {
+    char* p;
+
+    for (p = s; *p; p++) *p = (char)tolower((unsigned char)*p);
+    return s;
+}
+
+#endif
+
+// Bus operation counters. Build with -DDAS_BUS_STATS to count every access below
+// so a program can report its port traffic per sample; otherwise das_bus does not
+// exist and the accesses cost nothing.
+#if defined(DAS_BUS_STATS)
+typedef struct {
+    unsigned long writes;
+    unsigned long reads;
+    unsigned long skipped;		// shadowed writes dropped because the value was unchanged
+} das_bus_stats_t;
+
+static das_bus_stats_t das_bus;
+
+    #define das_bus_count(field, n)		rt_add_fetch(&das_bus.field, (unsigned long)(n))
+#else
+    #define das_bus_count(field, n)		((void)0)
+#endif
+
+static inline void das_out8(uintptr_t port, uint8_t val) { das_bus_count(writes, 1); das_port_out8(port, val); }
+static inline void das_out16(uintptr_t port, uint16_t val) { das_bus_count(writes, 1); das_port_out16(port, val); }
+static inline uint8_t das_in8(uintptr_t port) { das_bus_count(reads, 1); return das_port_in8(port); }
+static inline uint16_t das_in16(uintptr_t port) { das_bus_count(reads, 1); return das_port_in16(port); }
+static inline void das_out16s(uintptr_t port, const uint16_t* buf, unsigned n) { das_bus_count(writes, n); das_port_out16s(port, buf, n); }
+static inline void das_in16s(uintptr_t port, uint16_t* buf, unsigned n) { das_bus_count(reads, n); das_port_in16s(port, buf, n); }
+
+// Shadow registers
+//
+// The control registers are write-only, so the last value written to each is
+// kept here and a write that would not change it is dropped. Each shadowed
+// register must only be written by one thread at a time, and only through
+// these calls, or the shadow no longer matches the card.
+enum das_shadow_reg {
+    DAS_SHADOW_DA_CTL,
+    DAS_SHADOW_TRIGGER,
+    DAS_SHADOW_AUTOCAL,
+    DAS_SHADOW_DIO_CTL,
+    DAS_SHADOW_COUNT
+};
+
+typedef struct {
+    uint16_t value;
+    int valid;		// 0 until the first write, the card state is unknown before that
+} das_shadow_t;
+
+static das_shadow_t das_shadow[DAS_SHADOW_COUNT];
+
+static inline int das_out16_shadow(int reg, uintptr_t port, uint16_t val) {
+    // Write val unless the register already holds it. Returns 1 if the write went out.
+    if (das_shadow[reg].valid && das_shadow[reg].value == val) {
+        das_bus_count(skipped, 1);
+        return 0;
+    }
+    das_out16(port, val);
+    das_shadow[reg].value = val;
+    das_shadow[reg].valid = 1;
+    return 1;
+}
+
+static inline int das_out8_shadow(int reg, uintptr_t port, uint8_t val) {
+    if (das_shadow[reg].valid && das_shadow[reg].value == val) {
+        das_bus_count(skipped, 1);
+        return 0;
+    }
+    das_out8(port, val);
+    das_shadow[reg].value = val;
+    das_shadow[reg].valid = 1;
+    return 1;
+}
+
+static inline void das_shadow_invalidate(int reg) {
+    // Forget a register's value, e.g. after something else reprogrammed the card
+    das_shadow[reg].valid = 0;
+}
+
+static inline double das_8254_divisors(double rate, unsigned long* div1, unsigned long* div2) {
+    // Cascaded divisors for rate off the 10 MHz time base, without touching the counters. Returns the rate they give.
+    unsigned long total;
+
+    total = (unsigned long)(PACER_CLOCK_HZ / rate + 0.5);
+    if (total < 4) total = 4;
+
+    // Smallest first stage that keeps the second stage within 16 bits
+    *div1 = 2;
+    while (total / *div1 > 0xFFFF) (*div1)++;
+    *div2 = (total + *div1 / 2) / *div1;
+    return PACER_CLOCK_HZ / (double)(*div1 * *div2);
+}
+
+static inline double das_8254_cascade(uintptr_t ctl, uintptr_t ctr1, uintptr_t ctr2, double rate) {
+    // Program counters 1 and 2 of an 8254 as a cascaded rate generator off the 10 MHz time base. Returns the rate it gives.
+    unsigned long div1, div2;
+
+    rate = das_8254_divisors(rate, &div1, &div2);
+    das_out8(ctl, PACER_CTR1_MODE2);
+    das_out8(ctr1, div1 & 0xff);
+    das_out8(ctr1, (div1 >> 8) & 0xff);
+    das_out8(ctl, PACER_CTR2_MODE2);
+    das_out8(ctr2, div2 & 0xff);
+    das_out8(ctr2, (div2 >> 8) & 0xff);
+    return rate;
+}
+
+static inline void das_8254_hold(uintptr_t ctl) {
+    // Stop counters 1 and 2 of an 8254: each waits at its control word until das_8254_cascade() loads a divisor
+    das_out8(ctl, PACER_CTR1_MODE2);
+    das_out8(ctl, PACER_CTR2_MODE2);
+}
+
+#endif
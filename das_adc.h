@@ -0,0 +1,231 @@
+// Interrupt-driven ADC reads for the PCI-DAS1602
+//
+// das_adc_read() selects a channel, starts a software conversion and sleeps
+// until the card raises its end-of-conversion interrupt, instead of spinning
+// on the 0x4000 bit in MUXCHAN. While the conversion runs the reading thread
+// is blocked in InterruptWait(), so it no longer takes CPU from the DAC loop.
+// das_adc_wait() is the same wait for any source, e.g. the AD FIFO half-full
+// interrupt when conversions are left to pile up and are read in blocks.
+//
+// The IRQ is attached with InterruptAttachEvent(): the kernel masks the line
+// and wakes the thread, which acknowledges the card and unmasks it again. PCI
+// lines can be shared, so a wake-up only counts once the card's status says
+// the data is there. Without an IRQ, or if attaching fails, the same calls
+// poll the status bit and yield between polls.
+//
+// das_adc_open() must be called from the thread that reads: on QNX only the
+// attaching thread receives the interrupt event.
+//
+// Scan mode (das_adc_scan_*) programs the card once for a channel range in
+// burst mode: every tick of the TIMER 8254 converts the whole range at full
+// speed into the AD FIFO, with no software in the loop. das_adc_scan_read()
+// sleeps on the FIFO half-full interrupt and takes half a FIFO with one block
+// read; das_adc_scan_poll() drains whatever is there without blocking and
+// keeps the latest reading of every channel for low-rate consumers.
+
+#ifndef DAS_ADC_H
+#define DAS_ADC_H
+
+#include <sched.h>
+#include <string.h>
+#include "das1602.h"
+#include "rt_timing.h"
+
+#define DAS_ADC_MUX			ADC_MUX_SE_UNI_5V
+#define DAS_ADC_CHANNELS	16			// single ended inputs
+#define DAS_ADC_BLOCK		(AD_FIFO_SIZE / 2)
+#define DAS_ADC_TIMEOUT_NS	10000000LL	// a conversion takes ~10 us; give up on the interrupt after 10 ms
+
+typedef struct {
+    das_irq_t irq;
+    int use_irq;				// 0: polling fallback
+    uint16_t int_ctl;			// INTERRUPT enables and source in use
+    int chan;					// channel the MUX is set to, -1 before the first read
+    unsigned long conversions;
+    unsigned long interrupts;	// wake-ups that found data
+    unsigned long spurious;		// wake-ups from another device on a shared line
+    unsigned long timeouts;
+    int scan_first;				// scan mode: first channel of the range
+    int scan_count;				// channels per scan, 0 when not scanning
+    int scan_pos;				// range index of the next word out of the FIFO
+    double scan_rate;			// scans per second the TIMER gives
+    uint16_t latest[DAS_ADC_CHANNELS];	// newest reading of every channel in the range
+    unsigned long blocks;		// half-FIFO block reads
+} das_adc_t;
+
+static inline void das_adc_open(das_adc_t* adc, int use_irq) {
+    // One-off ADC set-up, then attach the IRQ with end-of-conversion as its source
+    memset(adc, 0, sizeof(*adc));
+    adc->chan = -1;
+
+    das_out16(INTERRUPT, INT_CLEAR_ALL);
+    das_out16_shadow(DAS_SHADOW_TRIGGER, TRIGGER, ADC_TRIG_DEFAULT);
+    das_out16_shadow(DAS_SHADOW_AUTOCAL, AUTOCAL, 0x007f);		// default calibration
+    das_out16(AD_FIFOCLR, 0);
+
+    adc->use_irq = use_irq && das_irq_attach(&adc->irq) == 0;
+    if (adc->use_irq) {
+        adc->int_ctl = ADC_INT_ENABLE | ADC_INT_SEL_EOC;
+        das_out16(INTERRUPT, adc->int_ctl | ADC_INT_CLEAR);
+    }
+}
+
+static inline void das_adc_set_source(das_adc_t* adc, uint16_t source) {
+    // Switch the interrupt between ADC_INT_SEL_EOC and ADC_INT_SEL_HALF
+    if (!adc->use_irq) return;
+    adc->int_ctl = ADC_INT_ENABLE | source;
+    das_out16(INTERRUPT, adc->int_ctl | ADC_INT_CLEAR);
+}
+
+static inline int das_adc_wait(das_adc_t* adc, uintptr_t status_port, uint16_t status_bit) {
+    // Block until status_bit is set in status_port. Returns -1 if it never came.
+    int64_t deadline;
+
+    if (!adc->use_irq) {
+        deadline = rt_now_ns() + DAS_ADC_TIMEOUT_NS;
+        while (!(das_in16(status_port) & status_bit)) {
+            if (rt_now_ns() > deadline) {
+                adc->timeouts++;
+                return -1;
+            }
+            sched_yield();
+        }
+        return 0;
+    }
+
+    for (;;) {
+        if (das_irq_wait(&adc->irq, DAS_ADC_TIMEOUT_NS) == -1) {
+            // Lost or never raised: one last look before giving up
+            adc->timeouts++;
+            return (das_in16(status_port) & status_bit) ? 0 : -1;
+        }
+        das_out16(INTERRUPT, adc->int_ctl | ADC_INT_CLEAR);
+        das_irq_unmask(&adc->irq);
+        if (das_in16(status_port) & status_bit) {
+            adc->interrupts++;
+            return 0;
+        }
+        adc->spurious++;
+    }
+}
+
+static inline int das_adc_convert(das_adc_t* adc, uint16_t* value) {
+    // Start one conversion on the selected channel and read it. Returns -1 on timeout.
+    das_out16(AD_DATA, 0);
+    if (das_adc_wait(adc, MUXCHAN, ADC_STAT_EOC) == -1) {
+        return -1;
+    }
+    *value = das_in16(AD_DATA);
+    adc->conversions++;
+    return 0;
+}
+
+static inline int das_adc_read(das_adc_t* adc, int chan, uint16_t* value) {
+    // Read one single-ended channel. Returns -1 on timeout.
+    uint16_t settle;
+
+    if (chan != adc->chan) {
+        // The card settles within one conversion when it scans by itself, so one
+        // throw-away conversion after a MUX switch replaces the old 1 ms sleep
+        das_out16(MUXCHAN, DAS_ADC_MUX | ((chan & 0x0f) << 4) | (chan & 0x0f));
+        adc->chan = chan;
+        if (das_adc_convert(adc, &settle) == -1) {
+            return -1;
+        }
+    }
+    return das_adc_convert(adc, value);
+}
+
+static inline void das_adc_close(das_adc_t* adc) {
+    das_out16(INTERRUPT, INT_CLEAR_ALL);
+    if (adc->use_irq) das_irq_detach(&adc->irq);
+}
+
+static inline double das_adc_scan_rate(int channels, double rate) {
+    // Scan rate das_adc_scan_start() will give for channels per scan: clamped to the ADC's limit and rounded to the TIMER's divisors
+    unsigned long div1, div2;
+
+    if (rate > ADC_RATE_MAX / channels) rate = ADC_RATE_MAX / channels;
+    return das_8254_divisors(rate, &div1, &div2);
+}
+
+static inline double das_adc_scan_start(das_adc_t* adc, int first, int last, double rate, uint16_t source) {
+    // Clock scans of channels first..last into the AD FIFO at rate per second. source is
+    // ADC_INT_SEL_HALF to sleep in das_adc_scan_read(), or 0 when only das_adc_scan_poll() is used.
+    // Returns the scan rate the TIMER actually gives.
+    if (first < 0) first = 0;
+    if (last > DAS_ADC_CHANNELS - 1) last = DAS_ADC_CHANNELS - 1;
+    if (last < first) last = first;
+    adc->scan_first = first;
+    adc->scan_count = last - first + 1;
+    adc->scan_pos = 0;
+    adc->chan = -1;
+
+    if (rate > ADC_RATE_MAX / adc->scan_count) rate = ADC_RATE_MAX / adc->scan_count;
+    adc->scan_rate = das_8254_cascade(COUNTCTL, TIMER1, TIMER2, rate);
+
+    if (source) {
+        das_adc_set_source(adc, source);
+    }
+    else {
+        adc->int_ctl = 0;
+        das_out16(INTERRUPT, INT_CLEAR_ALL);
+    }
+    das_out16_shadow(DAS_SHADOW_TRIGGER, TRIGGER, ADC_TRIG_DEFAULT | ADC_TRIG_BURST);
+    das_out16(AD_FIFOCLR, 0);
+    das_out16(MUXCHAN, ADC_MUX_SE_UNI_5V | ADC_MUX_PACER_INT | (last << 4) | first);
+    return adc->scan_rate;
+}
+
+static inline void das_adc_scan_store(das_adc_t* adc, const uint16_t* buf, unsigned n) {
+    // Sort FIFO words into latest[] by their place in the scan
+    unsigned i;
+
+    for (i = 0; i < n; i++) {
+        adc->latest[adc->scan_first + adc->scan_pos] = buf[i];
+        if (++adc->scan_pos == adc->scan_count) adc->scan_pos = 0;
+    }
+    adc->conversions += n;
+}
+
+static inline unsigned das_adc_scan_read(das_adc_t* adc, uint16_t* buf) {
+    // Sleep until the AD FIFO is half full, then move DAS_ADC_BLOCK words into buf with one block read.
+    // Returns the number of words, 0 on timeout.
+    if (das_adc_wait(adc, INTERRUPT, ADC_STAT_HALF_FULL) == -1) {
+        return 0;
+    }
+    das_in16s(AD_DATA, buf, DAS_ADC_BLOCK);
+    das_adc_scan_store(adc, buf, DAS_ADC_BLOCK);
+    adc->blocks++;
+    return DAS_ADC_BLOCK;
+}
+
+static inline unsigned das_adc_scan_poll(das_adc_t* adc) {
+    // Drain the AD FIFO without blocking: a block read when it is half full, then word by word. Returns words read.
+    uint16_t buf[DAS_ADC_BLOCK];
+    unsigned n = 0;
+
+    if (das_in16(INTERRUPT) & ADC_STAT_HALF_FULL) {
+        das_in16s(AD_DATA, buf, DAS_ADC_BLOCK);
+        das_adc_scan_store(adc, buf, DAS_ADC_BLOCK);
+        adc->blocks++;
+        n = DAS_ADC_BLOCK;
+    }
+    while (n < AD_FIFO_SIZE && (das_in16(MUXCHAN) & ADC_STAT_EOC)) {
+        buf[0] = das_in16(AD_DATA);
+        das_adc_scan_store(adc, buf, 1);
+        n++;
+    }
+    return n;
+}
+
+static inline void das_adc_scan_stop(das_adc_t* adc) {
+    // Back to software-started single conversions
+    das_out16(MUXCHAN, ADC_MUX_SE_UNI_5V);
+    das_out16_shadow(DAS_SHADOW_TRIGGER, TRIGGER, ADC_TRIG_DEFAULT);
+    das_out16(AD_FIFOCLR, 0);
+    adc->scan_count = 0;
+    if (adc->use_irq) das_adc_set_source(adc, ADC_INT_SEL_EOC);
+}
+
+#endif
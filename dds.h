@@ -0,0 +1,128 @@
+// Direct digital synthesis (DDS) for the PCI-DAS1602 waveform generator
+//
+// A 32-bit phase accumulator is advanced by a tuning word every sample and its
+// top DDS_TABLE_BITS bits index a one-cycle lookup table. Any frequency below
+// half the sample rate can be produced in steps of rate / 2^32, and every
+// waveform costs one add, one shift and one load per sample.
+//
+// Header only: include it from the program that generates the waveform and call
+// dds_init() once before the first sample.
+
+#ifndef DDS_H
+#define DDS_H
+
+#include <stdint.h>
+#include <math.h>
+#include "wave_simd.h"
+
+#define DDS_TABLE_BITS		10
+#define DDS_TABLE_SIZE		(1 << DDS_TABLE_BITS)
+#define DDS_INDEX_SHIFT		(32 - DDS_TABLE_BITS)
+#define DDS_PHASE_CYCLE		4294967296.0		// 2^32, one full cycle of phase
+
+#define DDS_PULSE_WIDTH		0.1				// PULSE duty cycle, as in ca2.c
+
+// Waveform types. SINE to SAWTOOTH keep the numbering used by ca2_final.c,
+// PULSE and CARDIAC are the extra shapes from ca2.c.
+enum dds_wave {
+    DDS_SINE,
+    DDS_SQUARE,
+    DDS_TRIANGLE,
+    DDS_SAWTOOTH,
+    DDS_PULSE,
+    DDS_CARDIAC,
+    DDS_WAVE_COUNT
+};
+
+typedef struct {
+    uint32_t phase;		// current position in the cycle, 2^32 = one cycle
+    uint32_t tuning;	// phase increment per sample
+} dds_t;
+
+// One cycle of every shape, normalised so that voltage = mean + amplitude * shape
+static float dds_shape[DDS_WAVE_COUNT][DDS_TABLE_SIZE];
+
+// One renderer per shape, generated from its formula: out[i] is the shape at
+// t = i / n, so a table is filled with no per-point switch on the type and
+// the branch-free shapes vectorise. Sine and cardiac, the only ones with
+// transcendentals, go through the block kernels of wave_simd.h instead.
+#define DDS_SHAPE_KERNEL(name, EXPR)									\
+    static inline void dds_shape_##name(float* out, int n) {			\
+        int i;															\
+        double t;														\
+        for (i = 0; i < n; i++) {										\
+            t = (double)i / n;											\
+            out[i] = (float)(EXPR);										\
+        }																\
+    }
+
+static inline void dds_shape_sine(float* out, int n) {
+    simd_sine(out, n, 0.0f, 1.0f / n);
+}
+
+DDS_SHAPE_KERNEL(square, (t < 0.5) ? 1.0 : -1.0)
+DDS_SHAPE_KERNEL(triangle, (t < 0.5) ? (4.0 * t - 1.0) : (3.0 - 4.0 * t))
+DDS_SHAPE_KERNEL(sawtooth, 2.0 * t - 1.0)
+DDS_SHAPE_KERNEL(pulse, (t < DDS_PULSE_WIDTH) ? 1.0 : 0.0)
+
+static inline void dds_shape_cardiac(float* out, int n) {
+    // exp(-200 (t - 0.2)^2) - 0.1 exp(-50 (t - 0.35)^2) + 0.05 exp(-300 (t - 0.75)^2)
+    simd_cardiac(out, n);
+}
+
+typedef void (*dds_shape_fn)(float* out, int n);
+
+// Indexed by enum dds_wave
+static const dds_shape_fn dds_shape_kernel[DDS_WAVE_COUNT] = {
+    dds_shape_sine, dds_shape_square, dds_shape_triangle, dds_shape_sawtooth, dds_shape_pulse, dds_shape_cardiac
+};
+
+static inline void dds_init(void) {
+    // Fill the shape tables. Transcendentals are only evaluated here, never per sample.
+    int type;
+
+    for (type = 0; type < DDS_WAVE_COUNT; type++) {
+        dds_shape_kernel[type](dds_shape[type], DDS_TABLE_SIZE);
+    }
+}
+
+static inline uint32_t dds_tuning_word(double frequency, double sample_rate) {
+    // Phase increment that gives frequency at sample_rate; resolution is sample_rate / 2^32
+    double word = frequency / sample_rate * DDS_PHASE_CYCLE;
+
+    if (word < 0.0) word = 0.0;
+    if (word > DDS_PHASE_CYCLE / 2) word = DDS_PHASE_CYCLE / 2;	// Nyquist
+    return (uint32_t)(word + 0.5);
+}
+
+static inline double dds_frequency(uint32_t tuning, double sample_rate) {
+    // Frequency actually produced by a tuning word
+    return tuning * sample_rate / DDS_PHASE_CYCLE;
+}
+
+static inline void dds_set(dds_t* dds, double frequency, double sample_rate) {
+    // Retune without touching the phase, so frequency changes are glitch free
+    dds->tuning = dds_tuning_word(frequency, sample_rate);
+}
+
+static inline unsigned dds_index(const dds_t* dds) {
+    return dds->phase >> DDS_INDEX_SHIFT;
+}
+
+static inline int dds_step(dds_t* dds) {
+    // Advance one sample. Returns 1 when the phase wrapped, i.e. a cycle just completed.
+    uint32_t last = dds->phase;
+
+    dds->phase += dds->tuning;
+    return dds->phase < last;
+}
+
+static inline float dds_next(dds_t* dds, int type) {
+    // Shape value for the current sample, then advance
+    float value = dds_shape[type][dds_index(dds)];
+
+    dds->phase += dds->tuning;
+    return value;
+}
+
+#endif
@@ -0,0 +1,185 @@
+// Output timing instrumentation: cycle-counter timestamps and jitter histograms
+//
+// jitter_sample() is called right after each DAC write. It reads the cycle
+// counter (ClockCycles() on QNX, the TSC on x86 Linux, CLOCK_MONOTONIC_RAW
+// elsewhere), which costs a few nanoseconds and no system call, and records:
+//   - the period error: time since the previous write minus the nominal period,
+//     into a log2 histogram of early and late errors;
+//   - the lateness: how long after its CLOCK_MONOTONIC deadline the sample
+//     actually went out, into a log2 histogram for percentiles, with the worst
+//     case and the number of samples that landed a whole period or more late
+//     (missed).
+//
+// Cycle counts are turned into nanoseconds with a scale calibrated against
+// CLOCK_MONOTONIC in jitter_init(), anchored at the same instant so deadlines
+// on CLOCK_MONOTONIC can be compared with cycle timestamps. Every
+// JITTER_ANCHOR_SAMPLES the anchor is taken again and the scale refined over
+// the whole run, so the two clocks cannot drift apart.
+//
+// There is one writer, the output thread, and every field is a plain word
+// store, so other threads can read the counters live without a lock; a live
+// reading may mix two consecutive samples, nothing worse.
+
+#ifndef JITTER_HIST_H
+#define JITTER_HIST_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include "rt_timing.h"
+#if defined(__QNX__)
+    #include <sys/neutrino.h>
+    #include <sys/syspage.h>
+#endif
+
+#define JITTER_BUCKETS		32		// bucket b holds errors in [2^(b-1), 2^b) ns, bucket 0 exactly 0
+#define JITTER_CALIBRATE_NS	20000000LL
+#define JITTER_ANCHOR_SAMPLES	1024	// samples between re-anchoring on CLOCK_MONOTONIC
+
+typedef struct {
+    int64_t period_ns;				// nominal time between samples
+    double ns_per_cycle;
+    uint64_t anchor_cycles;			// cycle counter and CLOCK_MONOTONIC read together
+    int64_t anchor_ns;
+    uint64_t start_cycles;			// first anchor, the baseline for refining ns_per_cycle
+    int64_t start_ns;
+    uint64_t last_cycles;			// previous sample, 0 before the first
+    volatile unsigned long samples;
+    volatile unsigned long early[JITTER_BUCKETS];	// period error histograms
+    volatile unsigned long late[JITTER_BUCKETS];
+    volatile int64_t max_early_ns;	// largest period errors either way
+    volatile int64_t max_late_ns;
+    volatile unsigned long lateness[JITTER_BUCKETS];	// lateness histogram, early samples in bucket 0
+    volatile int64_t max_lateness_ns;	// worst sample time past its deadline
+    volatile int64_t total_lateness_ns;
+    volatile unsigned long lateness_samples;
+    volatile unsigned long missed;	// samples a period or more past their deadline
+} jitter_hist_t;
+
+static inline uint64_t jitter_cycles(void) {
+#if defined(__QNX__)
+    return ClockCycles();
+#elif defined(__x86_64__) || defined(__i386__)
+    return __builtin_ia32_rdtsc();
+#else
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC_RAW, &ts);
+    return (uint64_t)ts.tv_sec * RT_NSEC_PER_SEC + ts.tv_nsec;
+#endif
+}
+
+static inline void jitter_init(jitter_hist_t* j, int64_t period_ns) {
+    // Calibrate the cycle counter against CLOCK_MONOTONIC; takes JITTER_CALIBRATE_NS on x86 Linux
+#if !defined(__QNX__) && (defined(__x86_64__) || defined(__i386__))
+    uint64_t c0;
+    int64_t t0;
+#endif
+
+    memset(j, 0, sizeof(*j));
+    j->period_ns = period_ns;
+#if defined(__QNX__)
+    j->ns_per_cycle = 1e9 / (double)SYSPAGE_ENTRY(qtime)->cycles_per_sec;
+#elif defined(__x86_64__) || defined(__i386__)
+    c0 = jitter_cycles();
+    t0 = rt_now_ns();
+    rt_sleep_until_ns(t0 + JITTER_CALIBRATE_NS);
+    j->ns_per_cycle = (double)(rt_now_ns() - t0) / (double)(jitter_cycles() - c0);
+#else
+    j->ns_per_cycle = 1.0;
+#endif
+    j->anchor_ns = j->start_ns = rt_now_ns();
+    j->anchor_cycles = j->start_cycles = jitter_cycles();
+}
+
+static inline int jitter_bucket(int64_t ns) {
+    int b = 0;
+
+    while (ns > 0 && b < JITTER_BUCKETS - 1) {
+        ns >>= 1;
+        b++;
+    }
+    return b;
+}
+
+static inline void jitter_sample(jitter_hist_t* j, int64_t deadline_ns) {
+    // Record one output sample. deadline_ns is its CLOCK_MONOTONIC deadline, 0 if it has none.
+    uint64_t now = jitter_cycles();
+    int64_t err, lateness;
+
+    if (j->last_cycles != 0) {
+        err = (int64_t)((double)(now - j->last_cycles) * j->ns_per_cycle) - j->period_ns;
+        if (err >= 0) {
+            j->late[jitter_bucket(err)]++;
+            if (err > j->max_late_ns) j->max_late_ns = err;
+        }
+        else {
+            j->early[jitter_bucket(-err)]++;
+            if (-err > j->max_early_ns) j->max_early_ns = -err;
+        }
+    }
+    j->last_cycles = now;
+    j->samples++;
+
+    if (deadline_ns != 0) {
+        lateness = j->anchor_ns + (int64_t)((double)(now - j->anchor_cycles) * j->ns_per_cycle) - deadline_ns;
+        j->lateness[jitter_bucket(lateness)]++;
+        if (lateness > j->max_lateness_ns) j->max_lateness_ns = lateness;
+        j->total_lateness_ns += lateness;
+        j->lateness_samples++;
+        if (lateness >= j->period_ns) j->missed++;
+    }
+
+    if (j->samples % JITTER_ANCHOR_SAMPLES == 0) {
+        j->anchor_ns = rt_now_ns();
+        j->anchor_cycles = jitter_cycles();
+        j->ns_per_cycle = (double)(j->anchor_ns - j->start_ns) / (double)(j->anchor_cycles - j->start_cycles);
+    }
+}
+
+static inline int64_t jitter_percentile(const volatile unsigned long* hist, double q) {
+    // Upper edge of the bucket holding the q quantile (0..1) of a histogram, 0 if it is empty
+    unsigned long total = 0, seen = 0;
+    int b;
+
+    for (b = 0; b < JITTER_BUCKETS; b++) total += hist[b];
+    if (total == 0) return 0;
+    for (b = 0; b < JITTER_BUCKETS - 1; b++) {
+        seen += hist[b];
+        if (seen >= q * total) break;
+    }
+    return (int64_t)1 << b;
+}
+
+static inline void jitter_print_ns(int64_t ns) {
+    if (ns < 1000) printf("%4lld ns", (long long)ns);
+    else if (ns < 1000000) printf("%4lld us", (long long)(ns / 1000));
+    else if (ns < 1000000000) printf("%4lld ms", (long long)(ns / 1000000));
+    else printf("%4lld s ", (long long)(ns / 1000000000));
+}
+
+static inline void jitter_summary(const jitter_hist_t* j) {
+    // One line, safe to call while the output thread is running
+    printf("[INFO] Output timing: %lu samples, period error -%.1f/+%.1f us, lateness mean %.1f us max %.1f us, missed: %lu\n",
+           j->samples, j->max_early_ns / 1e3, j->max_late_ns / 1e3,
+           j->lateness_samples ? j->total_lateness_ns / 1e3 / j->lateness_samples : 0.0, j->max_lateness_ns / 1e3, j->missed);
+}
+
+static inline void jitter_report(const jitter_hist_t* j) {
+    // Summary and the period error histogram, one row per non-empty bucket
+    int b;
+
+    jitter_summary(j);
+    printf("[INFO]   period error           early       late\n");
+    for (b = 0; b < JITTER_BUCKETS; b++) {
+        if (j->early[b] == 0 && j->late[b] == 0) continue;
+        printf("[INFO]   ");
+        jitter_print_ns(b ? (int64_t)1 << (b - 1) : 0);
+        printf(" - ");
+        jitter_print_ns((int64_t)1 << b);
+        printf("  %10lu %10lu\n", j->early[b], j->late[b]);
+    }
+}
+
+#endif
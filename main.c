@@ -1,12 +1,12 @@
+// Early draft of the waveform generator, superseded by ca2_final.c. Kept for
+// reference: it does not compile as it stands and is not part of the build.
+
 
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdbool.h>
 #include <unistd.h>
 #include <signal.h>
-#include <hw/pci.h>
-#include <hw/inout.h>
-#include <sys/neutrino.h>
 #include <sys/mman.h>
 #include <math.h>
 #include <pthread.h>
@@ -14,31 +14,7 @@
 #include <string.h>
 #include <termios.h>
 
-// Hardware registers definition											
-#define	INTERRUPT		iobase[1] + 0				// Badr1 + 0 : also ADC register
-#define	MUXCHAN			iobase[1] + 2				// Badr1 + 2
-#define	TRIGGER			iobase[1] + 4				// Badr1 + 4
-#define	AUTOCAL			iobase[1] + 6				// Badr1 + 6
-#define DA_CTLREG		iobase[1] + 8				// Badr1 + 8
-
-#define	AD_DATA			iobase[2] + 0				// Badr2 + 0
-#define	AD_FIFOCLR		iobase[2] + 2				// Badr2 + 2
-
-#define	TIMER0			iobase[3] + 0				// Badr3 + 0
-#define	TIMER1			iobase[3] + 1				// Badr3 + 1
-#define	TIMER2			iobase[3] + 2				// Badr3 + 2
-#define	COUNTCTL		iobase[3] + 3				// Badr3 + 3
-#define	DIO_PORTA		iobase[3] + 4				// Badr3 + 4
-#define	DIO_PORTB		iobase[3] + 5				// Badr3 + 5
-#define	DIO_PORTC		iobase[3] + 6				// Badr3 + 6
-#define	DIO_CTLREG		iobase[3] + 7				// Badr3 + 7
-#define	PACER1			iobase[3] + 8				// Badr3 + 8
-#define	PACER2			iobase[3] + 9				// Badr3 + 9
-#define	PACER3			iobase[3] + a				// Badr3 + a
-#define	PACERCTL		iobase[3] + b				// Badr3 + b
-
-#define DA_Data			iobase[4] + 0				// Badr4 + 0
-#define	DA_FIFOCLR		iobase[4] + 2				// Badr4 + 2
+#include "das1602.h"
 
 #define PI              3.14159265358979323846
 #define POINTS_PER_CYCLE 100
@@ -74,12 +50,6 @@ enum WaveformType {
 	NOTHING
 };
 
-// Set-up for PCI Device
-struct pci_dev_info info;
-void *hdl;
-
-uintptr_t iobase[6];
-int badr[5];	
 uint16_t adc_in;
 
 unsigned int i, count; // global type declaration for counter of loops
@@ -148,16 +118,16 @@ void reset()
 {
 										// Unreachable code
 										// Reset DAC to 5v
-	out16(DA_CTLREG, (short) 0x0a23);	
-	out16(DA_FIFOCLR, (short) 0);			
-	out16(DA_Data, 0x7fff);				// Mid range - Unipolar
+	das_out16(DA_CTLREG, (short) 0x0a23);	
+	das_out16(DA_FIFOCLR, (short) 0);			
+	das_out16(DA_Data, 0x7fff);				// Mid range - Unipolar
 	
-	out16(DA_CTLREG, (short) 0x0a43);	
-	out16(DA_FIFOCLR, (short) 0);			
-	out16(DA_Data, 0x7fff);				
+	das_out16(DA_CTLREG, (short) 0x0a43);	
+	das_out16(DA_FIFOCLR, (short) 0);			
+	das_out16(DA_Data, 0x7fff);				
 
 	printf("\n\nExit Demo Program\n");
-	pci_detach_device(hdl);
+	das_detach();
 		
 	free(data);
 	if (wave_file != NULL)
@@ -288,11 +258,11 @@ void toggle()
 								//*****************************************************************************
 								//Digital Port Functions
 								//*****************************************************************************	
-	out8(DIO_CTLREG, 0x90);		// Port A : Input,  Port B : Output,  Port C (upper | lower) : Output | Output			
+	das_out8(DIO_CTLREG, 0x90);		// Port A : Input,  Port B : Output,  Port C (upper | lower) : Output | Output			
 
-	temp_dio = in8(DIO_PORTA); 	// Read Port A
+	temp_dio = das_in8(DIO_PORTA); 	// Read Port A
 																						
-	out8(DIO_PORTB, temp_dio);	// output Port A value -> write to Port B
+	das_out8(DIO_PORTB, temp_dio);	// output Port A value -> write to Port B
 }
 
 void potentiometer()
@@ -301,12 +271,12 @@ void potentiometer()
 								// ADC Port Functions
 								//******************************************************************************
 								// Initialise Board								
-	out16(INTERRUPT,0x60c0);	// sets interrupts	 - Clears			
-	out16(TRIGGER,0x2081);		// sets trigger control: 10MHz, clear, Burst off,SW trig. default:20a0
-	out16(AUTOCAL,0x007f);		// sets automatic calibration : default
+	das_out16(INTERRUPT,0x60c0);	// sets interrupts	 - Clears			
+	das_out16(TRIGGER,0x2081);		// sets trigger control: 10MHz, clear, Burst off,SW trig. default:20a0
+	das_out16(AUTOCAL,0x007f);		// sets automatic calibration : default
 
-	out16(AD_FIFOCLR,0); 		// clear ADC buffer
-	out16(MUXCHAN,0x0D00);		// Write to MUX register - SW trigger, UP, SE, 5v, ch 0-0 	
+	das_out16(AD_FIFOCLR,0); 		// clear ADC buffer
+	das_out16(MUXCHAN,0x0D00);		// Write to MUX register - SW trigger, UP, SE, 5v, ch 0-0 	
 								// x x 0 0 | 1  0  0 1  | 0x 7   0 | Diff - 8 channels
 								// SW trig |Diff-Uni 5v| scan 0-7| Single - 16 channels
 	//printf("\n\nRead multiple ADC\n");
@@ -315,12 +285,12 @@ void potentiometer()
 	while (count < 0x02)
     {
 		chan = ((count & 0x0f) << 4) | (0x0f & count);
-		out16(MUXCHAN, (0x0D00 | chan));			// Set channel	 - burst mode off.
+		das_out16(MUXCHAN, (0x0D00 | chan));			// Set channel	 - burst mode off.
 		delay(1);							// allow MUX to settle
-		out16(AD_DATA, 0); 					// start ADC
-		while (!(in16(MUXCHAN) & 0x4000));
+		das_out16(AD_DATA, 0); 					// start ADC
+		while (!(das_in16(MUXCHAN) & ADC_STAT_EOC));
 
-		adc_in = in16(AD_DATA);
+		adc_in = das_in16(AD_DATA);
 		if (count == 0x00)
         {
 			amp = adc_in;
@@ -468,37 +438,8 @@ int waveGenerate(void)
 }
 
 void init_hardware(void) {
-	memset(&info, 0, sizeof(info));
-	if (pci_attach(0) < 0) {
-  		perror("pci_attach");
-  		exit(EXIT_FAILURE);
-  	}
-
-												/* Vendor and Device ID */
-	info.VendorId=0x1307;
-	info.DeviceId=0x01;
-
-	if ((hdl=pci_attach_device(0, PCI_SHARE|PCI_INIT_ALL, 0, &info)) == 0) {
-		perror("pci_attach_device");
-		exit(EXIT_FAILURE);
-	}
-												// Determine assigned BADRn IO addresses for PCI-DAS1602			
-
-	//printf("\nDAS 1602 Base addresses:\n\n");
-	for (i = 0; i < 5; i++) {
-		badr[i] = PCI_IO_ADDR(info.CpuBaseAddress[i]);
-	}
-	
-	//printf("\nReconfirm Iobase:\n");  		// map I/O base address to user space						
-	for (i = 0; i < 5; i++)
-    {					// expect CpuBaseAddress to be the same as iobase for PC
-		iobase[i] = mmap_device_io(0x0f, badr[i]);
-	}													
-												// Modify thread control privity
-	if (ThreadCtl(_NTO_TCTL_IO, 0) == -1) {
-		perror("Thread Control");
-		exit(1);
-	}
+												// Attach PCI-DAS1602, map BADRn and modify thread control privity
+	das_attach(0);
 }
 
 int main(int argc, char* argv[]) {
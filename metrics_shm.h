@@ -0,0 +1,173 @@
+// Live metrics in a POSIX shared-memory segment
+//
+// The generator publishes its counters and gauges into METRICS_SHM_NAME
+// (/dev/shmem on QNX, /dev/shm on Linux). A low-priority thread copies them
+// from the program's own variables a few times a second, so the real-time
+// threads pay nothing; monitoring tools map the segment read-only and never
+// talk to the process at all. resources/metrics_reader.c is such a tool.
+//
+// A publish is bracketed by metrics_begin()/metrics_end(), which make 'seq'
+// odd for its duration; metrics_read() copies the block and retries if seq was
+// odd or changed, so a reader always gets one consistent update.
+//
+// The layout only grows at the end. Readers check the magic and that 'size'
+// covers the fields they use.
+
+#ifndef METRICS_SHM_H
+#define METRICS_SHM_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sched.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "rt_atomic.h"
+#include "rt_timing.h"
+
+#define METRICS_SHM_NAME	"/das1602_metrics"
+#define METRICS_MAGIC		"DASMETR1"
+#define METRICS_VERSION		1
+#define METRICS_ADC_CHANNELS	16
+#define METRICS_READ_TRIES	10000
+
+typedef struct {
+    char magic[8];				// METRICS_MAGIC
+    uint32_t version;
+    uint32_t size;				// sizeof(metrics_t) of the writer
+    int32_t pid;
+    volatile uint32_t seq;		// odd while an update is being written
+    volatile int32_t running;	// cleared when the writer exits
+    uint32_t reserved;
+    int64_t start_ns;			// CLOCK_MONOTONIC when the segment was created
+    int64_t updated_ns;			// CLOCK_MONOTONIC of the last update
+
+    // Output counters
+    uint64_t samples;			// samples written to the DAC
+    uint64_t underruns;			// samples the producer did not have ready
+    uint64_t deadlines;			// output deadlines (or timer ticks) waited for
+    uint64_t deadlines_missed;
+    uint64_t bus_writes;
+    uint64_t bus_reads;
+    double sample_rate;			// output samples per second
+
+    // Current parameters
+    int32_t wave_type;
+    int32_t control_mode;		// 0 keyboard, 1 potentiometers
+    float amplitude;
+    float frequency;
+    float mean;
+    uint32_t reserved2;
+
+    // Inputs
+    uint64_t adc_conversions;
+    uint32_t adc_first;			// channels held in adc[]
+    uint32_t adc_count;
+    uint16_t adc[METRICS_ADC_CHANNELS];		// newest code per channel
+    uint32_t dio_porta;			// toggle switches
+
+    // Output timing, from the jitter histograms (0 when not measured)
+    uint64_t timing_samples;
+    int64_t lateness_p50_ns;	// percentiles are bucket upper edges, powers of two
+    int64_t lateness_p90_ns;
+    int64_t lateness_p99_ns;
+    int64_t lateness_p999_ns;
+    int64_t lateness_max_ns;
+    int64_t period_error_max_ns;
+    uint64_t timing_missed;
+} metrics_t;
+
+static inline metrics_t* metrics_create(void) {
+    // Create (or take over) the segment for writing. Returns NULL if shared memory is not available.
+    metrics_t* m;
+    int fd;
+
+    if ((fd = shm_open(METRICS_SHM_NAME, O_RDWR | O_CREAT, 0644)) == -1) {
+        return NULL;
+    }
+    if (ftruncate(fd, sizeof(metrics_t)) == -1) {
+        close(fd);
+        return NULL;
+    }
+    m = mmap(NULL, sizeof(metrics_t), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (m == MAP_FAILED) {
+        return NULL;
+    }
+
+    memset(m, 0, sizeof(*m));
+    m->version = METRICS_VERSION;
+    m->size = sizeof(metrics_t);
+    m->pid = getpid();
+    m->start_ns = m->updated_ns = rt_now_ns();
+    m->running = 1;
+    rt_barrier();
+    memcpy(m->magic, METRICS_MAGIC, sizeof(m->magic));
+    return m;
+}
+
+static inline void metrics_begin(metrics_t* m) {
+    rt_store_release(&m->seq, m->seq + 1);
+    rt_barrier();
+}
+
+static inline void metrics_end(metrics_t* m) {
+    m->updated_ns = rt_now_ns();
+    rt_store_release(&m->seq, m->seq + 1);
+}
+
+static inline void metrics_destroy(metrics_t* m) {
+    // Mark the writer gone and remove the name; readers still attached keep their mapping
+    m->running = 0;
+    munmap(m, sizeof(metrics_t));
+    shm_unlink(METRICS_SHM_NAME);
+}
+
+static inline const metrics_t* metrics_attach(void) {
+    // Map the segment read-only. Returns NULL if there is no writer or it is not ours.
+    const metrics_t* m;
+    struct stat st;
+    int fd;
+
+    if ((fd = shm_open(METRICS_SHM_NAME, O_RDONLY, 0)) == -1) {
+        return NULL;
+    }
+    if (fstat(fd, &st) == -1 || st.st_size < (off_t)sizeof(metrics_t)) {
+        close(fd);
+        return NULL;
+    }
+    m = mmap(NULL, sizeof(metrics_t), PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (m == MAP_FAILED) {
+        return NULL;
+    }
+    if (memcmp(m->magic, METRICS_MAGIC, sizeof(m->magic)) != 0 || m->size < sizeof(metrics_t)) {
+        munmap((void*)m, sizeof(metrics_t));
+        return NULL;
+    }
+    return m;
+}
+
+static inline int metrics_read(const metrics_t* m, metrics_t* out) {
+    // Consistent copy of one update. Returns -1 if no consistent copy could be had, e.g. the writer died mid-update.
+    uint32_t seq;
+    int tries;
+
+    for (tries = 0; tries < METRICS_READ_TRIES; tries++) {
+        seq = rt_load_acquire(&m->seq);
+        if (seq & 1) {
+            sched_yield();
+            continue;
+        }
+        memcpy(out, (const void*)m, sizeof(*out));
+        rt_barrier();
+        if (m->seq == seq) {
+            return 0;
+        }
+    }
+    return -1;
+}
+
+#endif
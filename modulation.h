@@ -0,0 +1,141 @@
+// Amplitude, frequency and phase modulation of the DDS output
+//
+// Any of the DDS shapes can modulate another: the modulator runs its own
+// phase accumulator at the modulation rate and its shape value m (-1..1)
+// scales the carrier's amplitude (AM), offsets its tuning word (FM) or
+// offsets its phase (PM) by the modulation depth:
+//   AM  v = mean + amplitude * (1 + depth * m) / (1 + depth) * carrier,  depth 0..1
+//   FM  f = frequency + depth * m,                                       depth in Hz
+//   PM  phase = phase + depth * m,                                       depth in radians, 0..pi
+// AM is scaled so that its peaks reach the set amplitude and no further.
+//
+// Everything per sample is integer: the shapes are kept as Q15 tables built
+// once from dds_shape[], the depth is a Q15 (AM) or phase-word (FM, PM) scale,
+// and the result is produced directly as a DAC code. A sample costs two table
+// lookups, at most three multiplies and no library call. Each kind has its own
+// block renderer, generated from one macro and picked in mod_setup(), so the
+// sample loop does not branch on the kind.
+//
+// The carrier is the caller's dds_t, so turning modulation on or off never
+// disturbs its phase.
+
+#ifndef MODULATION_H
+#define MODULATION_H
+
+#include <stdint.h>
+#include <math.h>
+#include "dds.h"
+
+#define MOD_Q15_ONE		32768
+
+enum mod_kind {
+    MOD_AM,
+    MOD_FM,
+    MOD_PM
+};
+
+typedef struct mod mod_t;
+typedef void (*mod_render_fn)(mod_t* mod, dds_t* carrier, unsigned short* out, uint32_t* phase, int n);
+
+struct mod {
+    int kind;
+    int carrier_type;
+    int modulator_type;
+    dds_t modulator;			// runs at the modulation rate
+    int32_t depth;				// AM: Q15 depth / (1 + depth); FM: tuning word deviation; PM: phase word deviation
+    int32_t am_base;			// AM: Q15 1 / (1 + depth)
+    int32_t mean_code;			// carrier mean and amplitude in DAC codes
+    int32_t amplitude_code;
+    mod_render_fn render;		// block renderer for the kind
+};
+
+// Q15 copies of dds_shape[], filled by mod_init()
+static int16_t mod_shape[DDS_WAVE_COUNT][DDS_TABLE_SIZE];
+
+static inline void mod_init(void) {
+    // Build the Q15 tables; call after dds_init()
+    int type, i;
+    float v;
+
+    for (type = 0; type < DDS_WAVE_COUNT; type++) {
+        for (i = 0; i < DDS_TABLE_SIZE; i++) {
+            v = dds_shape[type][i];
+            if (v > 32767.0f / MOD_Q15_ONE) v = 32767.0f / MOD_Q15_ONE;
+            if (v < -1.0f) v = -1.0f;
+            mod_shape[type][i] = (int16_t)lrintf(v * MOD_Q15_ONE);
+        }
+    }
+}
+
+// Block renderer for one kind. STEP advances the carrier and leaves the Q15
+// carrier value in 'value'; m is the Q15 modulator value and 'p' the carrier
+// phase before the step. The carrier phase of each sample is stored in phase[].
+#define MOD_RENDER_KERNEL(name, STEP)											\
+    static inline void mod_render_##name(mod_t* mod, dds_t* carrier, unsigned short* out, uint32_t* phase, int n) {	\
+        int i;																	\
+        int32_t m, value, code;													\
+        uint32_t p;																\
+        for (i = 0; i < n; i++) {												\
+            m = mod_shape[mod->modulator_type][dds_index(&mod->modulator)];		\
+            mod->modulator.phase += mod->modulator.tuning;						\
+            p = phase[i] = carrier->phase;										\
+            STEP;																\
+            code = mod->mean_code + (int32_t)(((int64_t)mod->amplitude_code * value) >> 15);	\
+            code = (code < 0) ? 0 : code;										\
+            code = (code > 0xFFFF) ? 0xFFFF : code;								\
+            out[i] = (unsigned short)code;										\
+        }																		\
+    }
+
+MOD_RENDER_KERNEL(am,
+    carrier->phase += carrier->tuning;
+    value = mod_shape[mod->carrier_type][p >> DDS_INDEX_SHIFT];
+    value = (int32_t)(((int64_t)value * (mod->am_base + ((mod->depth * m) >> 15))) >> 15))
+MOD_RENDER_KERNEL(fm,
+    carrier->phase += carrier->tuning + (int32_t)(((int64_t)mod->depth * m) >> 15);
+    value = mod_shape[mod->carrier_type][p >> DDS_INDEX_SHIFT])
+MOD_RENDER_KERNEL(pm,
+    carrier->phase += carrier->tuning;
+    p += (int32_t)(((int64_t)mod->depth * m) >> 15);
+    value = mod_shape[mod->carrier_type][p >> DDS_INDEX_SHIFT])
+
+static inline int32_t mod_phase_word(double cycles) {
+    // Signed phase-word deviation for a fraction of a cycle, saturated to the half cycle an int32 holds
+    double word = cycles * DDS_PHASE_CYCLE;
+
+    if (word >= INT32_MAX) return INT32_MAX;
+    if (word <= -INT32_MAX) return -INT32_MAX;
+    return (int32_t)lrint(word);
+}
+
+static inline void mod_setup(mod_t* mod, int kind, int modulator_type, float depth, float rate, double sample_rate) {
+    // Modulator shape, depth (AM index, FM Hz or PM radians) and rate in Hz
+    mod->kind = kind;
+    mod->modulator_type = modulator_type;
+    mod->modulator.phase = 0;
+    dds_set(&mod->modulator, rate, sample_rate);
+    switch (kind) {
+        case MOD_AM:
+            mod->depth = (int32_t)lrintf(depth / (1.0f + depth) * MOD_Q15_ONE);
+            mod->am_base = (int32_t)lrintf(1.0f / (1.0f + depth) * MOD_Q15_ONE);
+            mod->render = mod_render_am;
+            break;
+        case MOD_FM:
+            mod->depth = mod_phase_word(depth / sample_rate);
+            mod->render = mod_render_fm;
+            break;
+        case MOD_PM:
+            mod->depth = mod_phase_word(depth / (2.0 * M_PI));
+            mod->render = mod_render_pm;
+            break;
+    }
+}
+
+static inline void mod_carrier(mod_t* mod, int type, float amplitude, float mean) {
+    // Carrier shape and levels; its frequency is the tuning word of the dds_t passed to the renderer
+    mod->carrier_type = type;
+    mod->amplitude_code = (int32_t)(amplitude / 5.0f * 0xFFFF);
+    mod->mean_code = (int32_t)(mean / 5.0f * 0xFFFF);
+}
+
+#endif
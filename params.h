@@ -0,0 +1,80 @@
+// Seqlock-protected waveform parameters
+//
+// The waveform type, amplitude, frequency and mean are one block, published
+// together. Readers take a consistent snapshot with no lock: they copy the
+// block between two reads of a sequence counter and retry if it changed under
+// them. The block is kept twice and a writer updates one copy at a time, the
+// counter's low bit saying which copy is not being written (a latch), so a
+// reader never waits for a writer to finish. That matters for the SCHED_FIFO
+// cyclic executive: if it preempted a lower-priority writer mid-update on the
+// same CPU and waited for it, the writer would never run again. A reader only
+// retries when a writer made progress during its copy. Writers are serialised
+// by a mutex that readers never touch.
+//
+// Writers follow params_begin() / params_commit(): begin takes the writer lock
+// and hands back the current values to edit, commit publishes the edited block
+// and releases the lock. Nothing slow (printing, rendering) belongs between
+// the two; do it on the committed copy afterwards.
+
+#ifndef PARAMS_H
+#define PARAMS_H
+
+#include <pthread.h>
+#include <stdint.h>
+#include "rt_atomic.h"
+#include "rt_thread.h"
+
+typedef struct {
+    int wave_type;
+    float amplitude;
+    float frequency;
+    float mean;
+} wave_params_t;
+
+typedef struct {
+    volatile uint32_t seq;		// odd while a writer is updating value[0], even while it updates value[1]
+    wave_params_t value[2];		// readers copy value[seq & 1]
+    pthread_mutex_t lock;		// serialises writers only, never taken by readers; priority inheriting
+} params_t;
+
+static inline void params_init(params_t* params, const wave_params_t* initial) {
+    params->seq = 0;
+    params->value[0] = params->value[1] = *initial;
+    rt_mutex_init(&params->lock);		// shared with the UI threads
+}
+
+static inline void params_read(params_t* params, wave_params_t* out) {
+    // Lock-free consistent snapshot of all four values
+    uint32_t seq;
+
+    do {
+        seq = rt_load_acquire(&params->seq);
+        *out = *(volatile wave_params_t*)&params->value[seq & 1];
+        rt_barrier();
+    } while (params->seq != seq);
+}
+
+static inline void params_begin(params_t* params, wave_params_t* edit) {
+    // Writer side: take the writer lock and start from the current values
+    pthread_mutex_lock(&params->lock);
+    *edit = params->value[0];
+}
+
+static inline void params_commit(params_t* params, const wave_params_t* edit) {
+    // Publish the edited values and release the writer lock. Readers are sent to the other copy while each one is written.
+    rt_store_release(&params->seq, params->seq + 1);
+    rt_barrier();
+    *(volatile wave_params_t*)&params->value[0] = *edit;
+    rt_store_release(&params->seq, params->seq + 1);
+    rt_barrier();
+    *(volatile wave_params_t*)&params->value[1] = *edit;
+    pthread_mutex_unlock(&params->lock);
+}
+
+static inline void params_write(params_t* params, const wave_params_t* value) {
+    // Replace the whole block
+    pthread_mutex_lock(&params->lock);
+    params_commit(params, value);
+}
+
+#endif
@@ -0,0 +1,85 @@
+// Convert an ADC ring file written by multi_thread_test's adc_log mode to CSV
+//
+// Usage: adc_log_decode [-v] <ring file> [out.csv]
+//   -v  print volts (0-5V unipolar) instead of raw 16-bit codes
+//
+// Records are printed oldest first. The first column is seconds since the
+// capture started, the second the wall-clock time in seconds since the epoch.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#include "../adc_ringfile.h"
+
+int main(int argc, char *argv[])
+{
+    adc_ring_header_t hdr;
+    FILE *in, *out = stdout;
+    unsigned char rec[sizeof(int64_t) + ADC_RING_MAX_CHANNELS * sizeof(uint16_t) + 8];
+    uint16_t code;
+    uint64_t k, first;
+    int64_t t_ns;
+    int volts = 0, arg = 1;
+    unsigned c;
+
+    if (argc > 1 && strcmp(argv[1], "-v") == 0) {
+        volts = 1;
+        arg++;
+    }
+    if (argc - arg < 1 || argc - arg > 2) {
+        printf("Usage: %s [-v] <ring file> [out.csv]\n", argv[0]);
+        return 1;
+    }
+
+    if ((in = fopen(argv[arg], "rb")) == NULL) {
+        perror(argv[arg]);
+        return 1;
+    }
+    if (fread(&hdr, sizeof(hdr), 1, in) != 1 || memcmp(hdr.magic, ADC_RING_MAGIC, sizeof(hdr.magic)) != 0) {
+        fprintf(stderr, "%s: not an ADC ring file\n", argv[arg]);
+        return 1;
+    }
+    if (hdr.version != ADC_RING_VERSION || hdr.channels < 1 || hdr.channels > ADC_RING_MAX_CHANNELS || hdr.record_size > sizeof(rec)) {
+        fprintf(stderr, "%s: unsupported version %u or geometry\n", argv[arg], hdr.version);
+        return 1;
+    }
+    if (argc - arg == 2 && (out = fopen(argv[arg + 1], "w")) == NULL) {
+        perror(argv[arg + 1]);
+        return 1;
+    }
+
+    fprintf(stderr, "%llu records of %u channels from %u at %.1f scans/s (ring holds %llu)\n",
+            (unsigned long long)hdr.head, hdr.channels, hdr.first_channel, hdr.scan_rate, (unsigned long long)hdr.capacity);
+
+    fprintf(out, "t_s,wall_s");
+    for (c = 0; c < hdr.channels; c++) {
+        fprintf(out, ",ch%u", hdr.first_channel + c);
+    }
+    fprintf(out, "\n");
+
+    // Oldest surviving record first; after a wrap the ring starts at head % capacity
+    first = (hdr.head > hdr.capacity) ? hdr.head - hdr.capacity : 0;
+    for (k = first; k < hdr.head; k++) {
+        if (k == first || k % hdr.capacity == 0) {
+            fseek(in, (long)(hdr.header_size + (k % hdr.capacity) * hdr.record_size), SEEK_SET);
+        }
+        if (fread(rec, hdr.record_size, 1, in) != 1) {
+            fprintf(stderr, "%s: truncated at record %llu\n", argv[arg], (unsigned long long)k);
+            break;
+        }
+        memcpy(&t_ns, rec, sizeof(t_ns));
+        fprintf(out, "%.9f,%.6f", (t_ns - hdr.start_mono_ns) / 1e9, (t_ns - hdr.start_mono_ns + hdr.start_real_ns) / 1e9);
+        for (c = 0; c < hdr.channels; c++) {
+            memcpy(&code, rec + sizeof(t_ns) + c * sizeof(code), sizeof(code));
+            if (volts) fprintf(out, ",%.4f", code / 65535.0 * 5.0);
+            else fprintf(out, ",%u", code);
+        }
+        fprintf(out, "\n");
+    }
+
+    fclose(in);
+    if (out != stdout) fclose(out);
+    return 0;
+}
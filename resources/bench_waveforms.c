@@ -0,0 +1,595 @@
+// Waveform kernel micro-benchmarks
+//
+// Usage: bench_waveforms [-j] [-p points] [-s samples]
+//   -j  print the results as JSON, for tracking regressions (default: a table)
+//   -p  time the table fills at this size only (default: 20, 1024 and 100000,
+//       the sizes of ca2.c, the DDS tables and wave_generator.c)
+//   -s  samples to stream per run (default: 1000000, 20 s of output at 50 kHz)
+//
+// Build:  gcc -O2 -o bench_waveforms bench_waveforms.c -lm -lpthread             (SSE2)
+//         gcc -O2 -mavx2 -o bench_waveforms bench_waveforms.c -lm -lpthread      (AVX2)
+//
+// Two kinds of case, all producing 16-bit DAC codes at 2.5V +- 2.5V:
+//   table   one cycle rendered into a table, as ca2.c, wave_generator.c and
+//           SampleCode.c do before output and ca2_final.c does per setting.
+//           A block is one table.
+//   stream  samples produced as the output goes, in blocks of the ca2_final.c
+//           producer (PRODUCER_BLOCK): sin() per sample, a sinf() table, DDS
+//           lookups, sweeps, modulation, a recursive oscillator, SIMD blocks.
+//
+// Each case is run BENCH_RUNS times. ns and cycles per sample are from the
+// fastest run, ns as wall time with the timing included and cycles as the
+// blocks alone. The worst block is the slowest single block of all runs,
+// cold caches included; the p99 block is the upper edge of the power of two
+// bucket holding the 99th percentile. Outside a real-time scheduling class
+// the worst block mostly measures preemption: run under chrt -f for figures
+// that mean anything.
+//
+// Cache misses are counted with perf_event_open() on Linux when the kernel
+// allows it (perf_event_paranoid), and reported as unavailable otherwise.
+// The error is the largest difference in codes from the same output worked
+// out in double precision, for the cases with a closed form (sine, cardiac).
+// An error of 1 comes from the voltage being a float: voltage_to_dac() of the
+// exact sine, rounded to float, is 1 off too.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <math.h>
+#if defined(__linux__)
+    #include <linux/perf_event.h>
+    #include <sys/ioctl.h>
+    #include <sys/syscall.h>
+#endif
+
+#include "../rt_timing.h"
+#include "../jitter_hist.h"
+#include "../wave_table.h"
+#include "../wave_simd.h"
+#include "../sweep.h"
+#include "../modulation.h"
+
+#define BENCH_RUNS			5
+#define BENCH_TABLE_POINTS	2000000		// points per run of a table case, so small tables are timed over many fills
+#define BENCH_SAMPLES		1000000
+#define BENCH_BLOCK			32			// PRODUCER_BLOCK in ca2_final.c
+#define BENCH_RATE			50000.0		// PACER_SAMPLE_RATE in ca2_final.c
+#define BENCH_FREQUENCY		997.0		// stream frequency: not a divisor of the rate, so the phase never repeats exactly
+#define BENCH_LOOKUP_POINTS	1024		// sinf() table for the lookup case
+#define BENCH_MEAN			2.5f
+#define BENCH_AMPLITUDE		2.5f
+#define BENCH_CODE_SCALE	(0xFFFF / 2.0)	// (shape + 1) to codes at BENCH_MEAN +- BENCH_AMPLITUDE
+
+enum bench_kind {
+    BENCH_TABLE,
+    BENCH_STREAM
+};
+
+enum bench_shape {
+    BENCH_ANY,			// no closed form to check against
+    BENCH_SINE,
+    BENCH_CARDIAC
+};
+
+typedef struct {
+    int points;					// table cases: points per table
+    float* shape;				// points (table) or BENCH_BLOCK (stream) floats
+    float lookup[BENCH_LOOKUP_POINTS];
+    long n;						// samples streamed so far
+    double phase;				// lookup case: table position
+    double cycle;				// SIMD case: position in cycles, kept in [0, 1)
+    double osc_k, osc_y1, osc_y2;	// recursive oscillator: 2 cos(w) and the last two outputs
+    wave_tables_t tables;
+    wave_table_t* table;
+    dds_t dds;
+    sweep_t sweep;
+    mod_t mod;
+} bench_state_t;
+
+typedef void (*bench_fn)(bench_state_t* st, unsigned short* code, int n);
+
+typedef struct {
+    const char* name;
+    const char* source;			// the code it stands for
+    int kind;
+    int shape;
+    bench_fn fn;
+} bench_case_t;
+
+typedef struct {
+    int block;					// samples per block
+    long samples;				// samples per run
+    double ns_per_sample;
+    double cycles_per_sample;
+    double misses_per_ksample;	// < 0 if not counted
+    double worst_block_ns;
+    double mean_block_ns;
+    int64_t p99_block_ns;
+    int error;					// < 0 if not checked
+} bench_result_t;
+
+static double ns_per_cycle = 1.0;
+static int64_t timer_cycles = 0;	// cost of the two cycle counter reads around a block
+
+// Table cases: the code as it is in the tree
+
+// ca2.c generators at full amplitude
+#define BENCH_CA2_AMPLITUDE	100
+#define BENCH_CA2_KERNEL(name, EXPR)												\
+    static void ca2_##name(bench_state_t* st, unsigned short* code, int n) {		\
+        float value;																\
+        int i;																		\
+        (void)st;																	\
+        for (i = 0; i < n; i++) {													\
+            value = (EXPR);															\
+            code[i] = (unsigned short)((value + 1.0) * 0x7fff * BENCH_CA2_AMPLITUDE / 100);\
+        }																			\
+    }
+
+BENCH_CA2_KERNEL(triangle, 2.0 * fabs(i * (2.0 / n) - 1.0) - 1.0)
+
+static void ca2_scale(const float* shape, unsigned short* code, int n) {
+    // generate_waveform() after a wave_simd.h generator
+    int i;
+
+    for (i = 0; i < n; i++) code[i] = (unsigned short)((shape[i] + 1.0) * 0x7fff * BENCH_CA2_AMPLITUDE / 100);
+}
+
+static void ca2_sine(bench_state_t* st, unsigned short* code, int n) {
+    simd_sine(st->shape, n, 0.0f, 1.0f / n);
+    ca2_scale(st->shape, code, n);
+}
+
+static void ca2_cardiac(bench_state_t* st, unsigned short* code, int n) {
+    simd_cardiac(st->shape, n);
+    ca2_scale(st->shape, code, n);
+}
+
+// wave_generator.c, with a scaling its 0x8000 full scale to 0xFFFF
+static int sineWave(int i, int n, float a){
+    float delta=(2.0*3.142)/n;
+    return((int) (((sinf((float)(i*delta))) + 1.0) * 0.5 * a * 0x8000));
+}
+
+static int triangularWave(int i, int n, float a){
+    if(i<=(n/2)){
+        return((int)(((((float)i*2.0*((float)0x8000))/((float)n)))*((float) a)));
+    }
+    else{
+        return((int)((((float) 0x8000)-((((float) 0x8000)*((2.0*((float) i))-((float) n)))/((float) n)))*((float) a)));
+    }
+}
+
+static void wg_sine(bench_state_t* st, unsigned short* code, int n) {
+    int i;
+
+    (void)st;
+    for (i = 0; i < n; i++) code[i] = (unsigned short)sineWave(i, n, 0xFFFF / (float)0x8000);
+}
+
+static void wg_triangle(bench_state_t* st, unsigned short* code, int n) {
+    int i;
+
+    (void)st;
+    for (i = 0; i < n; i++) code[i] = (unsigned short)triangularWave(i, n, 0xFFFF / (float)0x8000);
+}
+
+static void sample_sine(bench_state_t* st, unsigned short* code, int n) {
+    // SampleCode.c generate_data(), amp 0xFFFF
+    float delta, dummy;
+    int i;
+
+    (void)st;
+    for (i = 0; i < n; i++) {
+        delta = (float) (2.0 * 3.142) / (float) n;
+        dummy = (sinf(i*delta) + 1.0) * 0xFFFF / 2;
+        code[i] = (unsigned) dummy;
+    }
+}
+
+// ca2_final.c: dds.h shape kernel then wave_codes(), as dds_init() and wave_table_render()
+static void dds_sine_table(bench_state_t* st, unsigned short* code, int n) {
+    dds_shape_kernel[DDS_SINE](st->shape, n);
+    wave_codes(code, st->shape, n, BENCH_MEAN, BENCH_AMPLITUDE);
+}
+
+static void dds_cardiac_table(bench_state_t* st, unsigned short* code, int n) {
+    dds_shape_kernel[DDS_CARDIAC](st->shape, n);
+    wave_codes(code, st->shape, n, BENCH_MEAN, BENCH_AMPLITUDE);
+}
+
+// wave_simd.h kernels, scalar and vector
+
+static void poly_sine_table(bench_state_t* st, unsigned short* code, int n) {
+    simd_sine_scalar(st->shape, n, 0.0f, 1.0f / n);
+    simd_codes_scalar(code, st->shape, n, BENCH_MEAN, BENCH_AMPLITUDE);
+}
+
+static void simd_sine_table(bench_state_t* st, unsigned short* code, int n) {
+    simd_sine(st->shape, n, 0.0f, 1.0f / n);
+    simd_codes(code, st->shape, n, BENCH_MEAN, BENCH_AMPLITUDE);
+}
+
+static void poly_cardiac_table(bench_state_t* st, unsigned short* code, int n) {
+    simd_cardiac_scalar(st->shape, n);
+    simd_codes_scalar(code, st->shape, n, BENCH_MEAN, BENCH_AMPLITUDE);
+}
+
+static void simd_cardiac_table(bench_state_t* st, unsigned short* code, int n) {
+    simd_cardiac(st->shape, n);
+    simd_codes(code, st->shape, n, BENCH_MEAN, BENCH_AMPLITUDE);
+}
+
+// Stream cases, BENCH_FREQUENCY at BENCH_RATE
+
+static void stream_sin(bench_state_t* st, unsigned short* code, int n) {
+    // sin() and voltage_to_dac() per sample, no table
+    int i;
+
+    for (i = 0; i < n; i++, st->n++) {
+        code[i] = voltage_to_dac(BENCH_MEAN + BENCH_AMPLITUDE * sin(2.0 * M_PI * BENCH_FREQUENCY * st->n / BENCH_RATE));
+    }
+}
+
+static void stream_lookup(bench_state_t* st, unsigned short* code, int n) {
+    // A sinf() table stepped through at a fractional rate, as the table players play theirs
+    double step = BENCH_FREQUENCY * BENCH_LOOKUP_POINTS / BENCH_RATE;
+    int i;
+
+    for (i = 0; i < n; i++) {
+        code[i] = voltage_to_dac(BENCH_MEAN + BENCH_AMPLITUDE * st->lookup[(int)st->phase]);
+        st->phase += step;
+        if (st->phase >= BENCH_LOOKUP_POINTS) st->phase -= BENCH_LOOKUP_POINTS;
+    }
+}
+
+static void stream_dds(bench_state_t* st, unsigned short* code, int n) {
+    // ca2_final.c render_table(): one code table lookup per sample, table swap checked at each cycle end
+    int i;
+
+    for (i = 0; i < n; i++) {
+        code[i] = st->table->code[dds_index(&st->dds)];
+        if (dds_step(&st->dds)) {
+            st->table = wave_tables_swap(&st->tables, st->table);
+            st->dds.tuning = st->table->tuning;
+        }
+    }
+}
+
+static void stream_sweep(bench_state_t* st, unsigned short* code, int n) {
+    // ca2_final.c render_sweep(): a log sweep, shape lookup and voltage_to_dac() per sample
+    float amplitude;
+    int i;
+
+    for (i = 0; i < n; i++) {
+        amplitude = sweep_step(&st->sweep, &st->dds);
+        code[i] = voltage_to_dac(st->table->mean + amplitude * dds_shape[st->table->type][dds_index(&st->dds)]);
+        if (dds_step(&st->dds)) {
+            st->table = wave_tables_swap(&st->tables, st->table);
+        }
+    }
+}
+
+static void stream_modulated(bench_state_t* st, unsigned short* code, int n) {
+    // ca2_final.c render_modulated(): modulation.h block renderer
+    uint32_t phase[BENCH_BLOCK];
+
+    st->mod.render(&st->mod, &st->dds, code, phase, n);
+}
+
+static void stream_oscillator(bench_state_t* st, unsigned short* code, int n) {
+    // Recursive oscillator y[n] = 2 cos(w) y[n-1] - y[n-2]: one multiply per sample, no table.
+    // In double; in float it drifts by whole codes within a second.
+    double y;
+    int i;
+
+    for (i = 0; i < n; i++) {
+        st->shape[i] = (float)st->osc_y1;
+        y = st->osc_k * st->osc_y1 - st->osc_y2;
+        st->osc_y2 = st->osc_y1;
+        st->osc_y1 = y;
+    }
+    simd_codes(code, st->shape, n, BENCH_MEAN, BENCH_AMPLITUDE);
+}
+
+static void stream_simd(bench_state_t* st, unsigned short* code, int n) {
+    // wave_simd.h: a block of simd_sine() from the current position, then simd_codes()
+    double dt = BENCH_FREQUENCY / BENCH_RATE;
+
+    simd_sine(st->shape, n, (float)st->cycle, (float)dt);
+    simd_codes(code, st->shape, n, BENCH_MEAN, BENCH_AMPLITUDE);
+    st->cycle += n * dt;
+    st->cycle -= floor(st->cycle);
+}
+
+static const bench_case_t bench_cases[] = {
+    { "ca2 sine",             "ca2.c generate_sine",              BENCH_TABLE,  BENCH_SINE,    ca2_sine },
+    { "ca2 triangle",         "ca2.c generate_triangle",          BENCH_TABLE,  BENCH_ANY,     ca2_triangle },
+    { "ca2 cardiac",          "ca2.c generate_cardiac",           BENCH_TABLE,  BENCH_CARDIAC, ca2_cardiac },
+    { "wave_generator sine",  "wave_generator.c sineWave",        BENCH_TABLE,  BENCH_SINE,    wg_sine },
+    { "wave_generator tri",   "wave_generator.c triangularWave",  BENCH_TABLE,  BENCH_ANY,     wg_triangle },
+    { "samplecode sine",      "SampleCode.c generate_data",       BENCH_TABLE,  BENCH_SINE,    sample_sine },
+    { "dds sine table",       "ca2_final.c dds_init+wave_codes",  BENCH_TABLE,  BENCH_SINE,    dds_sine_table },
+    { "dds cardiac table",    "ca2_final.c dds_init+wave_codes",  BENCH_TABLE,  BENCH_CARDIAC, dds_cardiac_table },
+    { "poly sine scalar",     "wave_simd.h scalar",               BENCH_TABLE,  BENCH_SINE,    poly_sine_table },
+    { "simd sine",            "wave_simd.h " SIMD_ISA,            BENCH_TABLE,  BENCH_SINE,    simd_sine_table },
+    { "poly cardiac scalar",  "wave_simd.h scalar",               BENCH_TABLE,  BENCH_CARDIAC, poly_cardiac_table },
+    { "simd cardiac",         "wave_simd.h " SIMD_ISA,            BENCH_TABLE,  BENCH_CARDIAC, simd_cardiac_table },
+    { "sin per sample",       "sin() per output sample",          BENCH_STREAM, BENCH_SINE,    stream_sin },
+    { "sinf table lookup",    "sineWaveEx.c, SampleCode.c",       BENCH_STREAM, BENCH_SINE,    stream_lookup },
+    { "dds lookup",           "ca2_final.c render_table",         BENCH_STREAM, BENCH_SINE,    stream_dds },
+    { "dds sweep",            "ca2_final.c render_sweep",         BENCH_STREAM, BENCH_ANY,     stream_sweep },
+    { "dds am",               "ca2_final.c render_modulated",     BENCH_STREAM, BENCH_ANY,     stream_modulated },
+    { "recursive oscillator", "y = 2cos(w) y1 - y2, double",      BENCH_STREAM, BENCH_SINE,    stream_oscillator },
+    { "simd sine block",      "wave_simd.h " SIMD_ISA,            BENCH_STREAM, BENCH_SINE,    stream_simd },
+};
+
+#define BENCH_CASES		(int)(sizeof(bench_cases) / sizeof(bench_cases[0]))
+
+static void bench_reset(bench_state_t* st) {
+    // Start every stream from sample 0
+    double w = 2.0 * M_PI * BENCH_FREQUENCY / BENCH_RATE;
+
+    st->n = 0;
+    st->phase = 0.0;
+    st->cycle = 0.0;
+    st->osc_k = 2.0 * cos(w);
+    st->osc_y1 = 0.0;
+    st->osc_y2 = -sin(w);
+    st->table = wave_tables_init(&st->tables, BENCH_RATE, DDS_SINE, BENCH_AMPLITUDE, BENCH_FREQUENCY, BENCH_MEAN);
+    st->dds.phase = 0;
+    st->dds.tuning = st->table->tuning;
+    sweep_start(&st->sweep, SWEEP_LOG, 20.0f, 20000.0f, BENCH_AMPLITUDE, BENCH_AMPLITUDE, 1.0, BENCH_RATE, 1);
+    mod_setup(&st->mod, MOD_AM, DDS_SINE, 0.5f, 5.0f, BENCH_RATE);
+    mod_carrier(&st->mod, DDS_SINE, BENCH_AMPLITUDE, BENCH_MEAN);
+}
+
+static unsigned short bench_reference(int shape, double t) {
+    // Code of the shape at t cycles, in double precision
+    double v;
+
+    t -= floor(t);
+    if (shape == BENCH_CARDIAC) {
+        v = exp(-200.0 * (t - 0.2) * (t - 0.2)) - 0.1 * exp(-50.0 * (t - 0.35) * (t - 0.35)) + 0.05 * exp(-300.0 * (t - 0.75) * (t - 0.75));
+    }
+    else {
+        v = sin(2.0 * M_PI * t);
+    }
+    v = (v + 1.0) * BENCH_CODE_SCALE;
+    return (unsigned short)((v < 0.0) ? 0.0 : (v > 65535.0) ? 65535.0 : v);
+}
+
+static int bench_error(const bench_case_t* c, bench_state_t* st, unsigned short* code, int block, long samples) {
+    // Largest code difference from the reference over one run
+    long s, i;
+    int e, err = 0;
+
+    bench_reset(st);
+    for (s = 0; s < samples; s += block) {
+        c->fn(st, code, block);
+        for (i = 0; i < block; i++) {
+            e = abs((int)code[i] - (int)bench_reference(c->shape, (c->kind == BENCH_TABLE) ? (double)i / block : (s + i) * BENCH_FREQUENCY / BENCH_RATE));
+            if (e > err) err = e;
+        }
+    }
+    return err;
+}
+
+// Cache miss counter, Linux only
+
+static int perf_open(void) {
+    // Counter for this thread's last-level cache misses, -1 if there is none
+#if defined(__linux__)
+    struct perf_event_attr attr;
+
+    memset(&attr, 0, sizeof(attr));
+    attr.type = PERF_TYPE_HARDWARE;
+    attr.size = sizeof(attr);
+    attr.config = PERF_COUNT_HW_CACHE_MISSES;
+    attr.disabled = 1;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    return (int)syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0);
+#else
+    return -1;
+#endif
+}
+
+static void perf_start(int fd) {
+#if defined(__linux__)
+    if (fd != -1) {
+        ioctl(fd, PERF_EVENT_IOC_RESET, 0);
+        ioctl(fd, PERF_EVENT_IOC_ENABLE, 0);
+    }
+#endif
+}
+
+static long long perf_stop(int fd) {
+    // Misses since perf_start(), -1 if not counted
+    long long count = -1;
+
+#if defined(__linux__)
+    if (fd != -1) {
+        ioctl(fd, PERF_EVENT_IOC_DISABLE, 0);
+        if (read(fd, &count, sizeof(count)) != sizeof(count)) count = -1;
+    }
+#endif
+    return count;
+}
+
+static void bench_calibrate(void) {
+    // ns per cycle counter tick, from jitter_init(), and the cost of timing an empty block
+    jitter_hist_t j;
+    uint64_t c0, best = UINT64_MAX;
+    int i;
+
+    jitter_init(&j, 0);
+    ns_per_cycle = j.ns_per_cycle;
+    for (i = 0; i < 1000; i++) {
+        c0 = jitter_cycles();
+        c0 = jitter_cycles() - c0;
+        if (c0 < best) best = c0;
+    }
+    timer_cycles = (int64_t)best;
+}
+
+static void bench_run(const bench_case_t* c, bench_state_t* st, int perf_fd, int block, long samples, bench_result_t* res) {
+    unsigned short* code = malloc(block * sizeof(*code));
+    long blocks = samples / block, b;
+    int r;
+    int64_t t0, ns, best_ns = INT64_MAX, cycles, run_cycles, best_cycles = 0, worst = 0;
+    long long misses, total_misses = 0;
+    uint64_t c0;
+    unsigned long hist[JITTER_BUCKETS];
+
+    if (code == NULL) {
+        fprintf(stderr, "Out of memory for %d samples\n", block);
+        exit(1);
+    }
+
+    memset(hist, 0, sizeof(hist));
+    for (r = 0; r < BENCH_RUNS; r++) {
+        bench_reset(st);
+        run_cycles = 0;
+        perf_start(perf_fd);
+        t0 = rt_now_ns();
+        for (b = 0; b < blocks; b++) {
+            c0 = jitter_cycles();
+            c->fn(st, code, block);
+            cycles = (int64_t)(jitter_cycles() - c0) - timer_cycles;
+            run_cycles += cycles;
+            if (cycles > worst) worst = cycles;
+            hist[jitter_bucket((int64_t)(cycles * ns_per_cycle))]++;
+        }
+        ns = rt_now_ns() - t0;
+        misses = perf_stop(perf_fd);
+        total_misses = (misses < 0 || total_misses < 0) ? -1 : total_misses + misses;
+        if (ns < best_ns) {
+            best_ns = ns;
+            best_cycles = run_cycles;
+        }
+    }
+
+    res->block = block;
+    res->samples = blocks * block;
+    res->ns_per_sample = (double)best_ns / res->samples;
+    res->cycles_per_sample = (double)best_cycles / res->samples;
+    res->misses_per_ksample = (total_misses < 0) ? -1.0 : total_misses * 1000.0 / ((double)res->samples * BENCH_RUNS);
+    res->worst_block_ns = worst * ns_per_cycle;
+    res->mean_block_ns = best_cycles * ns_per_cycle / blocks;
+    res->p99_block_ns = jitter_percentile(hist, 0.99);
+    if (res->p99_block_ns > res->worst_block_ns) res->p99_block_ns = (int64_t)res->worst_block_ns;
+    res->error = (c->shape == BENCH_ANY) ? -1 : bench_error(c, st, code, block, (c->kind == BENCH_TABLE) ? block : samples);
+    free(code);
+}
+
+static void print_table_header(const char* title) {
+    printf("\n%s\n", title);
+    printf("  %-21s %-34s %6s %8s %8s %8s %9s %9s %6s\n", "case", "stands for", "block", "ns/smp", "cyc/smp", "miss/1k", "p99 us", "worst us", "error");
+}
+
+static void print_table_row(const bench_case_t* c, const bench_result_t* res) {
+    char misses[16], error[16];
+
+    if (res->misses_per_ksample < 0) snprintf(misses, sizeof(misses), "-");
+    else snprintf(misses, sizeof(misses), "%.2f", res->misses_per_ksample);
+    if (res->error < 0) snprintf(error, sizeof(error), "-");
+    else snprintf(error, sizeof(error), "%d", res->error);
+    printf("  %-21s %-34s %6d %8.2f %8.2f %8s %9.2f %9.2f %6s\n", c->name, c->source, res->block, res->ns_per_sample,
+           res->cycles_per_sample, misses, res->p99_block_ns / 1e3, res->worst_block_ns / 1e3, error);
+}
+
+static void print_json_row(const bench_case_t* c, const bench_result_t* res, int first) {
+    printf("%s    {\"case\": \"%s\", \"source\": \"%s\", \"kind\": \"%s\", \"block\": %d, \"samples\": %ld, "
+           "\"ns_per_sample\": %.4f, \"cycles_per_sample\": %.4f, ", first ? "" : ",\n", c->name, c->source,
+           (c->kind == BENCH_TABLE) ? "table" : "stream", res->block, res->samples, res->ns_per_sample, res->cycles_per_sample);
+    if (res->misses_per_ksample < 0) printf("\"cache_misses_per_ksample\": null, ");
+    else printf("\"cache_misses_per_ksample\": %.4f, ", res->misses_per_ksample);
+    printf("\"mean_block_ns\": %.1f, \"p99_block_ns\": %lld, \"worst_block_ns\": %.1f, ", res->mean_block_ns,
+           (long long)res->p99_block_ns, res->worst_block_ns);
+    if (res->error < 0) printf("\"max_error_codes\": null}");
+    else printf("\"max_error_codes\": %d}", res->error);
+}
+
+int main(int argc, char *argv[])
+{
+    static const int sizes[] = { 20, 1024, 100000 };
+    static bench_state_t st;
+    bench_result_t res;
+    long samples = BENCH_SAMPLES;
+    int json = 0, points = 0, perf_fd, opt, s, c, first = 1, i;
+    char title[64];
+
+    while ((opt = getopt(argc, argv, "jp:s:")) != -1) {
+        switch (opt) {
+            case 'j': json = 1; break;
+            case 'p': points = (atoi(optarg) > 0) ? atoi(optarg) : -1; break;
+            case 's': samples = atol(optarg); break;
+            default: points = -1; break;
+        }
+    }
+    if (points < 0 || samples < BENCH_BLOCK || optind != argc) {
+        printf("Usage: %s [-j] [-p points] [-s samples]\n", argv[0]);
+        return 1;
+    }
+
+    dds_init();
+    mod_init();
+    for (i = 0; i < BENCH_LOOKUP_POINTS; i++) {
+        st.lookup[i] = sinf((float)(2.0 * M_PI) * i / BENCH_LOOKUP_POINTS);
+    }
+    bench_calibrate();
+    perf_fd = perf_open();
+
+    if (json) {
+        printf("{\n  \"isa\": \"%s\", \"simd_width\": %d, \"ns_per_cycle\": %.6f, \"runs\": %d, \"cache_misses\": %s,\n  \"results\": [\n",
+               SIMD_ISA, SIMD_WIDTH, ns_per_cycle, BENCH_RUNS, (perf_fd != -1) ? "true" : "false");
+    }
+    else {
+        printf("Waveform kernels, %s build (%d floats per vector), %.3f ns per cycle, cache misses %s\n", SIMD_ISA, SIMD_WIDTH,
+               ns_per_cycle, (perf_fd != -1) ? "counted" : "not available");
+    }
+
+    for (s = 0; s < (int)(sizeof(sizes) / sizeof(sizes[0])); s++) {
+        if (points > 0 && s > 0) break;
+        st.points = (points > 0) ? points : sizes[s];
+        if ((st.shape = malloc(st.points * sizeof(*st.shape))) == NULL) {
+            fprintf(stderr, "Out of memory for %d points\n", st.points);
+            return 1;
+        }
+        if (!json) {
+            snprintf(title, sizeof(title), "Tables of %d points", st.points);
+            print_table_header(title);
+        }
+        for (c = 0; c < BENCH_CASES; c++) {
+            if (bench_cases[c].kind != BENCH_TABLE) continue;
+            bench_run(&bench_cases[c], &st, perf_fd, st.points,
+                      ((long)BENCH_TABLE_POINTS + st.points - 1) / st.points * st.points, &res);
+            if (json) print_json_row(&bench_cases[c], &res, first);
+            else print_table_row(&bench_cases[c], &res);
+            first = 0;
+        }
+        free(st.shape);
+    }
+
+    if ((st.shape = malloc(BENCH_BLOCK * sizeof(*st.shape))) == NULL) {
+        return 1;
+    }
+    if (!json) {
+        snprintf(title, sizeof(title), "Streams of %ld samples at %.0f Hz", samples, BENCH_FREQUENCY);
+        print_table_header(title);
+    }
+    for (c = 0; c < BENCH_CASES; c++) {
+        if (bench_cases[c].kind != BENCH_STREAM) continue;
+        bench_run(&bench_cases[c], &st, perf_fd, BENCH_BLOCK, samples, &res);
+        if (json) print_json_row(&bench_cases[c], &res, first);
+        else print_table_row(&bench_cases[c], &res);
+        first = 0;
+    }
+    free(st.shape);
+
+    if (json) printf("\n  ]\n}\n");
+    if (perf_fd != -1) close(perf_fd);
+    return 0;
+}
@@ -0,0 +1,81 @@
+// Print the live metrics ca2_final publishes in shared memory
+//
+// Usage: metrics_reader [-w interval_ms]
+//   -w  keep printing every interval_ms until the generator exits (default: print once)
+//
+// Rates are worked out between two readings, so the first reading only shows totals.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+
+#include "../metrics_shm.h"
+
+static const char* wave_names[] = { "Sine", "Square", "Triangle", "Sawtooth", "Pulse", "Cardiac", "Arbitrary" };
+
+static void print_metrics(const metrics_t* m, const metrics_t* prev) {
+    double dt;
+    uint32_t c;
+
+    printf("pid %d, up %.1f s, updated %.0f ms ago%s\n", m->pid, (m->updated_ns - m->start_ns) / 1e9,
+           (rt_now_ns() - m->updated_ns) / 1e6, m->running ? "" : " (exited)");
+    printf("  output     %llu samples at %.0f/s, underruns %llu, deadlines %llu missed %llu\n",
+           (unsigned long long)m->samples, m->sample_rate, (unsigned long long)m->underruns,
+           (unsigned long long)m->deadlines, (unsigned long long)m->deadlines_missed);
+    if (prev && m->updated_ns > prev->updated_ns) {
+        dt = (m->updated_ns - prev->updated_ns) / 1e9;
+        printf("  rates      %.0f samples/s, %.0f bus writes/s, %.0f bus reads/s\n", (m->samples - prev->samples) / dt,
+               (m->bus_writes - prev->bus_writes) / dt, (m->bus_reads - prev->bus_reads) / dt);
+    }
+    printf("  waveform   %s, %.2f Hz, amplitude %.2f V, mean %.2f V, %s control\n",
+           (m->wave_type >= 0 && m->wave_type < 7) ? wave_names[m->wave_type] : "?", m->frequency, m->amplitude, m->mean,
+           m->control_mode ? "potentiometer" : "keyboard");
+    printf("  inputs     ADC %llu conversions:", (unsigned long long)m->adc_conversions);
+    for (c = m->adc_first; c < m->adc_first + m->adc_count && c < METRICS_ADC_CHANNELS; c++) {
+        printf(" ch%u %.3f V", c, m->adc[c] / 65535.0 * 5.0);
+    }
+    printf(", DIO port A 0x%02x\n", m->dio_porta);
+    if (m->timing_samples > 0) {
+        printf("  timing     lateness p50 <%.1f us, p90 <%.1f us, p99 <%.1f us, p99.9 <%.1f us, max %.1f us; period error max %.1f us; missed %llu\n",
+               m->lateness_p50_ns / 1e3, m->lateness_p90_ns / 1e3, m->lateness_p99_ns / 1e3, m->lateness_p999_ns / 1e3,
+               m->lateness_max_ns / 1e3, m->period_error_max_ns / 1e3, (unsigned long long)m->timing_missed);
+    }
+    fflush(stdout);
+}
+
+int main(int argc, char *argv[])
+{
+    const metrics_t* shm;
+    metrics_t now, prev;
+    int interval_ms = 0, have_prev = 0;
+
+    if (argc == 3 && strcmp(argv[1], "-w") == 0 && (interval_ms = atoi(argv[2])) > 0) {
+        // watch mode
+    }
+    else if (argc != 1) {
+        printf("Usage: %s [-w interval_ms]\n", argv[0]);
+        return 1;
+    }
+
+    if ((shm = metrics_attach()) == NULL) {
+        fprintf(stderr, "No metrics segment %s: is the generator running?\n", METRICS_SHM_NAME);
+        return 1;
+    }
+
+    do {
+        if (metrics_read(shm, &now) == -1) {
+            fprintf(stderr, "Metrics segment stuck mid-update\n");
+            return 1;
+        }
+        print_metrics(&now, have_prev ? &prev : NULL);
+        prev = now;
+        have_prev = 1;
+        if (interval_ms > 0 && now.running) {
+            usleep(interval_ms * 1000);
+        }
+    } while (interval_ms > 0 && now.running);
+
+    return 0;
+}
@@ -1,9 +1,6 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <unistd.h>
-#include <hw/pci.h>
-#include <hw/inout.h>
-#include <sys/neutrino.h>
 #include <sys/mman.h>
 #include <sys/types.h>
 #include <math.h>
@@ -12,38 +9,19 @@
 #include <errno.h>
 #include <time.h>
 #include <fcntl.h>
+#include <signal.h>
 #include <unistd.h>
 
 //#include <cstdio>
 //#include <cstdlib>
 //#include <csignal>
 
+#include "../das1602.h"
+#include "../das_adc.h"
+#include "../adc_ringfile.h"
 
-#define INTERRUPT iobase[1] + 0  // Badr1 + 0 : also ADC register
-#define MUXCHAN iobase[1] + 2    // Badr1 + 2
-#define TRIGGER iobase[1] + 4    // Badr1 + 4
-#define AUTOCAL iobase[1] + 6    // Badr1 + 6
-#define DA_CTLREG iobase[1] + 8  // Badr1 + 8
-#define AD_DATA iobase[2] + 0    // Badr2 + 0
-#define AD_FIFOCLR iobase[2] + 2 // Badr2 + 2
-#define TIMER0 iobase[3] + 0     // Badr3 + 0
-#define TIMER1 iobase[3] + 1     // Badr3 + 1
-#define TIMER2 iobase[3] + 2     // Badr3 + 2
-#define COUNTCTL iobase[3] + 3   // Badr3 + 3
-#define DIO_PORTA iobase[3] + 4  // Badr3 + 4
-#define DIO_PORTB iobase[3] + 5  // Badr3 + 5
-#define DIO_PORTC iobase[3] + 6  // Badr3 + 6
-#define DIO_CTLREG iobase[3] + 7 // Badr3 + 7
-#define PACER1 iobase[3] + 8     // Badr3 + 8
-#define PACER2 iobase[3] + 9     // Badr3 + 9
-#define PACER3 iobase[3] + a     // Badr3 + a
-#define PACERCTL iobase[3] + b   // Badr3 + b
-#define DA_Data iobase[4] + 0    // Badr4 + 0
-#define DA_FIFOCLR iobase[4] + 2 // Badr4 + 2
 #define DEBUG 1
 
-int badr[5];
-uintptr_t iobase[6];
 int wave_mode;
 int mode;
 int ctrl_mode;
@@ -65,68 +43,20 @@ pthread_t tasks[3];
 pthread_attr_t attr;
 void *status;
 
-int int_sig = 1;
+volatile sig_atomic_t int_sig = 1;    // stop flag for the task loops
 int initial_switch = 0;
 
+// adc_log mode: scans of channels 0..adclog_last streamed into a binary ring file
+#define ADCLOG_DEFAULT_RATE 1000.0    // scans per second
+#define ADCLOG_DEFAULT_SECONDS 3600   // history kept in the ring before it wraps
+adc_ring_t adc_log;
+int adclog_last = 1;
+double adclog_rate = ADCLOG_DEFAULT_RATE;
+
 void setup()
 {
-    struct pci_dev_info info;
-    void *hdl;
-    int i;
-
-    memset(&info, 0, sizeof(info));
-    if (pci_attach(0) < 0)
-    {
-        perror("pci_attach");
-        exit(EXIT_FAILURE);
-    }
-
-    /* Vendor and Device ID */
-    info.VendorId = 0x1307;
-    info.DeviceId = 0x01;
-
-    if ((hdl = pci_attach_device(0, PCI_SHARE | PCI_INIT_ALL, 0, &info)) == 0)
-    {
-        perror("pci_attach_device");
-        exit(EXIT_FAILURE);
-    }
-
-    for (i = 0; i < 6; i++)
-    { // Another printf BUG ? - Break printf to two statements
-        if (info.BaseAddressSize[i] > 0)
-        {
-            printf("Aperture %d  Base 0x%x Length %d Type %s\n", i,
-                   PCI_IS_MEM(info.CpuBaseAddress[i]) ? (int)PCI_MEM_ADDR(info.CpuBaseAddress[i]) : (int)PCI_IO_ADDR(info.CpuBaseAddress[i]), info.BaseAddressSize[i],
-                   PCI_IS_MEM(info.CpuBaseAddress[i]) ? "MEM" : "IO");
-        }
-    }
-
-    printf("IRQ %d\n", info.Irq);
-    // Assign BADRn IO addresses for PCI-DAS1602
-    if (DEBUG)
-    {
-        printf("\nDAS 1602 Base addresses:\n\n");
-        for (i = 0; i < 5; i++)
-        {
-            badr[i] = PCI_IO_ADDR(info.CpuBaseAddress[i]);
-            if (DEBUG)
-                printf("Badr[%d] : %x\n", i, badr[i]);
-        }
-
-        printf("\nReconfirm Iobase:\n"); // map I/O base address to user space
-        for (i = 0; i < 5; i++)
-        { // expect CpuBaseAddress to be the same as iobase for PC
-            iobase[i] = mmap_device_io(0x0f, badr[i]);
-            printf("Index %d : Address : %x ", i, badr[i]);
-            printf("IOBASE  : %x \n", iobase[i]);
-        }
-    }
-    // Modify thread control privity
-    if (ThreadCtl(_NTO_TCTL_IO, 0) == -1)
-    {
-        perror("Thread Control");
-        exit(1);
-    }
+    // Attach the PCI-DAS1602, print its apertures and IRQ, map BADRn and modify thread control privity
+    das_attach(1);
 }
 
 
@@ -136,6 +66,11 @@ void signalHandler(int signum) {
 	int rc;
 	int kill;
 	
+	if (mode == 2) {
+	    int_sig = 0;        // adc_log: main joins the tasks, then closes the ring
+	    return;
+	}
+
 	sleep(1);
 	
     //printf("\nInterrupt signal (%d) received. Exiting program...\n", signum);
@@ -208,8 +143,8 @@ void *sollog_dac_task(void *arg) // Output to Voltmeter
 
         for (i = 0; i < 100; i++)
         {
-            out16(DA_CTLREG, 0x0a23); // DA Enable, #0, #1, SW 5V unipolar		2/6
-            out16(DA_FIFOCLR, 0);     // Clear DA FIFO  buffer
+            if (das_out16_shadow(DAS_SHADOW_DA_CTL, DA_CTLREG, DAC_CTL_SW_SCAN)) // DA Enable, #0-#1 scan, SW 5V unipolar, only when not already set
+                das_out16(DA_FIFOCLR, 0);     // Clear DA FIFO  buffer, scan restarts at #0
             
             pthread_mutex_lock(&status_mutex);
            	if( condition == 0 )
@@ -217,10 +152,8 @@ void *sollog_dac_task(void *arg) // Output to Voltmeter
          	condition =0;
             
             
-            out16(DA_Data, (short)pot_amplitude);
-            out16(DA_CTLREG, 0x0a43); // DA Enable, #1, #1, SW 5V unipolar		2/6
-            out16(DA_FIFOCLR, 0);     // Clear DA FIFO  buffer
-            out16(DA_Data, (short)pot_amplitude);
+            das_out16(DA_Data, (short)pot_amplitude);   // #0
+            das_out16(DA_Data, (short)pot_amplitude);   // #1
             printf("DAC Data [%4x]: %4x\r", i, i); // print DAC
 
             fflush(stdout);
@@ -245,13 +178,9 @@ void *sollog_adc_task(void *arg)
 {
     int len;
     char buffer[32];
+    das_adc_t adc;
 
-    out16(INTERRUPT, 0x60c0); // sets interrupts	 - Clears
-    out16(TRIGGER, 0x2081);   // sets trigger control: 10MHz, clear, Burst off,SW trig. default:20a0
-    out16(AUTOCAL, 0x007f);   // sets automatic calibration : default
-
-    out16(AD_FIFOCLR, 0); // clear ADC buffer
-    out16(MUXCHAN, 0x0D00);
+    das_adc_open(&adc, 1); // clear interrupts, trigger control: 10MHz, Burst off, SW trig., default calibration, EOC interrupt
 
     printf("\n\nRead multiple ADC\n");
     
@@ -262,13 +191,7 @@ void *sollog_adc_task(void *arg)
         if(condition == 1 )
          		pthread_cond_wait( &cond, &status_mutex );
         condition =1;
-        chan = ((count & 0x0f) << 4) | (0x0f & count);
-        out16(MUXCHAN, 0x0D00 | chan); // Set channel	 - burst mode off.
-        delay(1);                      // allow mux to settle
-        out16(AD_DATA, 0);             // start ADC
-        while (!(in16(MUXCHAN) & 0x4000));
-
-        adc_in = in16(AD_DATA);
+        das_adc_read(&adc, count, &adc_in); // set channel, start ADC, sleep until end of conversion
 
         if (count == 0x00) // Frequency
         {
@@ -309,6 +232,7 @@ void *sollog_adc_task(void *arg)
         pthread_mutex_unlock(&status_mutex);
         }
 
+    das_adc_close(&adc);
     printf("ADC work is done\n");
     pthread_exit((void *) arg);
 }
@@ -328,8 +252,8 @@ void *dac_task(void *arg) // Output to Voltmeter
 
         for (i = 0; i < 100; i++)
         {
-            out16(DA_CTLREG, 0x0a23); // DA Enable, #0, #1, SW 5V unipolar		2/6
-            out16(DA_FIFOCLR, 0);     // Clear DA FIFO  buffer
+            if (das_out16_shadow(DAS_SHADOW_DA_CTL, DA_CTLREG, DAC_CTL_SW_SCAN)) // DA Enable, #0-#1 scan, SW 5V unipolar, only when not already set
+                das_out16(DA_FIFOCLR, 0);     // Clear DA FIFO  buffer, scan restarts at #0
             
             pthread_mutex_lock(&status_mutex);
            	if( condition == 0 )
@@ -345,10 +269,8 @@ void *dac_task(void *arg) // Output to Voltmeter
             
             
             
-            out16(DA_Data, (short)tmp_amplitude);
-            out16(DA_CTLREG, 0x0a43); // DA Enable, #1, #1, SW 5V unipolar		2/6
-            out16(DA_FIFOCLR, 0);     // Clear DA FIFO  buffer
-            out16(DA_Data, (short)tmp_amplitude);
+            das_out16(DA_Data, (short)tmp_amplitude);   // #0
+            das_out16(DA_Data, (short)tmp_amplitude);   // #1
             printf("DAC Data [%4x]: %4x\r", i, i); // print DAC
 
             fflush(stdout);
@@ -371,13 +293,9 @@ void *adc_task(void *arg)
 {
     int len;
     char buffer[32];
+    das_adc_t adc;
 
-    out16(INTERRUPT, 0x60c0); // sets interrupts	 - Clears
-    out16(TRIGGER, 0x2081);   // sets trigger control: 10MHz, clear, Burst off,SW trig. default:20a0
-    out16(AUTOCAL, 0x007f);   // sets automatic calibration : default
-
-    out16(AD_FIFOCLR, 0); // clear ADC buffer
-    out16(MUXCHAN, 0x0D00);
+    das_adc_open(&adc, 1); // clear interrupts, trigger control: 10MHz, Burst off, SW trig., default calibration, EOC interrupt
 
     printf("\n\nRead multiple ADC\n");
     
@@ -388,13 +306,7 @@ void *adc_task(void *arg)
         if(condition == 1 )
          		pthread_cond_wait( &cond, &status_mutex );
         condition =1;
-        chan = ((count & 0x0f) << 4) | (0x0f & count);
-        out16(MUXCHAN, 0x0D00 | chan); // Set channel	 - burst mode off.
-        delay(1);                      // allow mux to settle
-        out16(AD_DATA, 0);             // start ADC
-        while (!(in16(MUXCHAN) & 0x4000));
-
-        adc_in = in16(AD_DATA);
+        das_adc_read(&adc, count, &adc_in); // set channel, start ADC, sleep until end of conversion
 
         if (count == 0x00) // Frequency
         {
@@ -436,20 +348,49 @@ void *adc_task(void *arg)
         pthread_mutex_unlock(&status_mutex);
         }
 
+    das_adc_close(&adc);
     printf("ADC work is done\n");
     pthread_exit((void *) arg);
 }
 
+void *adclog_task(void *arg)
+{
+    uint16_t block[DAS_ADC_BLOCK];
+    unsigned n;
+    das_adc_t adc;
+
+    das_adc_open(&adc, 1);
+    das_adc_scan_start(&adc, 0, adclog_last, adclog_rate, ADC_INT_SEL_HALF); // burst scans clocked into the AD FIFO
+
+    printf("\n\nLogging ADC ch 0-%d at %.1f scans/s\n", adclog_last, adc.scan_rate);
+
+    while(int_sig){
+        n = das_adc_scan_read(&adc, block);   // sleep until the FIFO is half full, then one block read
+        if (n > 0)
+            adc_ring_append_words(&adc_log, block, n, rt_now_ns());
+        adc_ring_sync(&adc_log, 0);           // batched: only every ADC_RING_SYNC_BYTES or second
+    }
+
+    das_adc_scan_stop(&adc);
+    das_adc_close(&adc);
+    printf("ADC logging is done\n");
+    pthread_exit((void *) arg);
+}
+
 void *dio_task(void *arg)
 {
 	
-	while(1){
-    out8(DIO_CTLREG, 0x90);
-    dio_in = in8(DIO_PORTA);
-    if ( in8(DIO_PORTA) == 0xFF)
+	while(int_sig){
+    das_out8_shadow(DAS_SHADOW_DIO_CTL, DIO_CTLREG, 0x90);
+    dio_in = das_in8(DIO_PORTA);
+    if ( das_in8(DIO_PORTA) == 0xFF)
 {
     		printf("\nInterrupt signal from switch received. Exiting program...\n");
     		//printf("\nInterrupt signal SIGINT received. Exiting program now...\n", signum);
+            if (mode == 2) {
+                int_sig = 0;    // adc_log: main closes the ring once the tasks are joined
+                break;
+            }
     		printf("Goodbye!\n");
             close(fd);
             exit(0);
@@ -457,7 +398,7 @@ void *dio_task(void *arg)
      }
      }
      
-   	 //return NULL;
+   	 return NULL;
 }
 
 void *user_io_task(void *arg)
@@ -587,9 +528,31 @@ int main(int argc, char *argv[])
             return 1;
         }
     }
+    else if (strcmp(argv[1], "adc_log") == 0) {
+        long seconds = ADCLOG_DEFAULT_SECONDS;
+
+        mode = 2;
+        if (argc < 3 || argc > 6) {
+            printf("Usage %s %s <ring file> [last channel] [scans/s] [seconds kept]\n", argv[0], argv[1]);
+            printf("Decode with: adc_log_decode <ring file> > log.csv\n");
+            return 1;
+        }
+        if (argc > 3) adclog_last = atoi(argv[3]);
+        if (argc > 4) adclog_rate = atof(argv[4]);
+        if (argc > 5) seconds = atol(argv[5]);
+        if (adclog_last < 0 || adclog_last > DAS_ADC_CHANNELS - 1 || adclog_rate <= 0 || seconds <= 0) {
+            printf("Channels 0 ~ 15, scan rate and seconds must be positive\n");
+            return 1;
+        }
+        // The ring's timestamps and capacity go by the rate the TIMER will actually give, not the one asked for
+        adclog_rate = das_adc_scan_rate(adclog_last + 1, adclog_rate);
+        if (adc_ring_open(&adc_log, argv[2], 0, adclog_last + 1, adclog_rate, (uint64_t)(adclog_rate * seconds)) == -1) {
+            return 1;
+        }
+    }
     else {
         printf("Mode not found!");
-        printf("Mode available: wf_gen, sol_log");
+        printf("Mode available: wf_gen, sol_log, adc_log");
         return 1;
     }
 
@@ -612,8 +575,18 @@ int main(int argc, char *argv[])
         pthread_create(&tasks[2], NULL, dio_task, NULL);
         //pthread_create(&tasks[3], NULL, user_io_task, NULL);
     }
+    else if (mode == 2){
+        pthread_create(&tasks[0], NULL, adclog_task, NULL);
+        pthread_create(&tasks[1], NULL, dio_task, NULL);
+        pthread_join(tasks[0], NULL);
+        pthread_join(tasks[1], NULL);
+        adc_ring_close(&adc_log);   // both tasks are done: flush and unmap the ring
+        printf("Goodbye!\n");
+        close(fd);
+        return 0;
+    }
 
-    for (i=0; i<3; i++){
+    for (i=0; i<3 && mode != 2; i++){
     	pthread_join(tasks[i], NULL);
     }
     
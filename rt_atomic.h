@@ -0,0 +1,24 @@
+// Minimal atomics for sharing data with the real-time threads
+//
+// Built on the GCC __sync builtins so the same code compiles with the qcc
+// (gcc 4.x) toolchain on QNX and with any current gcc/clang on Linux.
+
+#ifndef RT_ATOMIC_H
+#define RT_ATOMIC_H
+
+// Full memory barrier
+#define rt_barrier()				__sync_synchronize()
+
+// Load that later loads and stores cannot move above
+#define rt_load_acquire(ptr)		({ __typeof__(*(ptr)) rt_v_ = *(volatile __typeof__(*(ptr))*)(ptr); rt_barrier(); rt_v_; })
+
+// Store that earlier loads and stores cannot move below
+#define rt_store_release(ptr, val)	do { rt_barrier(); *(volatile __typeof__(*(ptr))*)(ptr) = (val); } while (0)
+
+// Atomically replace *ptr with val and return the old value (full barrier)
+#define rt_exchange(ptr, val)		({ __typeof__(*(ptr)) rt_o_; do { rt_o_ = *(volatile __typeof__(*(ptr))*)(ptr); } while (!__sync_bool_compare_and_swap((ptr), rt_o_, (val))); rt_o_; })
+
+// Atomically add and return the new value (full barrier)
+#define rt_add_fetch(ptr, val)		__sync_add_and_fetch((ptr), (val))
+
+#endif
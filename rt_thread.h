@@ -0,0 +1,196 @@
+// Real-time thread set-up: policy, priority, CPU pinning, prefaulted stacks
+//
+// rt_thread_create() starts a thread from an rt_thread_attr_t. The policy and
+// priority are set explicitly on creation rather than inherited, and the
+// thread pins itself to its CPU and touches its whole stack before it runs
+// any user code. With mlockall(MCL_CURRENT | MCL_FUTURE) in force that leaves
+// no page fault waiting in the thread's first deep call. If the policy cannot
+// be set (no privileges), the thread is still started with default
+// scheduling and the failure is reported.
+//
+// The attributes can be overridden per thread from a text file, one thread
+// per line:
+//
+//     # name      policy  priority  cpu  stack_kb
+//     output      fifo    30        1    64
+//     keyboard    other   0         -1   0
+//
+// policy is fifo, rr or other; cpu -1 leaves the thread free to migrate;
+// stack_kb 0 keeps the default stack size.
+//
+// rt_mutex_init() makes a priority-inheritance mutex: a low-priority UI
+// thread holding it runs at the priority of the highest waiter, so a busy
+// terminal cannot stall a real-time thread waiting on the same lock.
+
+#ifndef RT_THREAD_H
+#define RT_THREAD_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <pthread.h>
+#include <sched.h>
+#if defined(__QNX__)
+    #include <sys/neutrino.h>
+#endif
+#if defined(__QNX__) || defined(__linux__)
+    #include <alloca.h>
+#endif
+
+#define RT_THREAD_NAME_MAX		16
+#define RT_STACK_PREFAULT		(64 * 1024)		// touched when the stack size is left at the default
+#define RT_STACK_RESERVE		(8 * 1024)		// left untouched below the prefault for the thread's own frames
+#define RT_PAGE_SIZE			4096
+
+typedef struct {
+    char name[RT_THREAD_NAME_MAX];
+    int policy;					// SCHED_FIFO, SCHED_RR or SCHED_OTHER
+    int priority;
+    int cpu;					// CPU to pin to, -1 for any
+    size_t stack_size;			// bytes, 0 for the default
+} rt_thread_attr_t;
+
+typedef struct {
+    void* (*func)(void*);
+    void* arg;
+    rt_thread_attr_t attr;
+} rt_thread_start_t;
+
+static inline int rt_thread_pin(int cpu) {
+    // Pin the calling thread to one CPU. Returns -1 if that is not possible here.
+#if defined(__QNX__)
+    if (cpu < 0 || cpu > 31) return -1;		// the runmask is one 32-bit word
+    return ThreadCtl(_NTO_TCTL_RUNMASK, (void*)(uintptr_t)(1u << cpu)) == -1 ? -1 : 0;
+#elif defined(CPU_SET)
+    cpu_set_t set;
+
+    if (cpu < 0 || cpu >= CPU_SETSIZE) return -1;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    return sched_setaffinity(0, sizeof(set), &set);
+#else
+    (void)cpu;
+    return -1;		// glibc only declares cpu_set_t with _GNU_SOURCE
+#endif
+}
+
+static inline void rt_stack_prefault(size_t size) {
+    // Touch one byte per page of the next 'size' bytes of stack
+    volatile unsigned char* stack;
+    size_t i;
+
+    if (size == 0) return;
+    stack = alloca(size);
+    for (i = 0; i < size; i += RT_PAGE_SIZE) {
+        stack[i] = 0;
+    }
+}
+
+static inline void* rt_thread_trampoline(void* arg) {
+    rt_thread_start_t start = *(rt_thread_start_t*)arg;
+
+    free(arg);
+    if (start.attr.cpu >= 0 && rt_thread_pin(start.attr.cpu) == -1) {
+        printf("[INFO] Could not pin thread %s to CPU %d\n", start.attr.name, start.attr.cpu);
+    }
+    // Never touch more than an explicitly sized stack holds; a stack too small for the reserve is left alone
+    if (start.attr.stack_size == 0) rt_stack_prefault(RT_STACK_PREFAULT);
+    else if (start.attr.stack_size > RT_STACK_RESERVE) rt_stack_prefault(start.attr.stack_size - RT_STACK_RESERVE);
+    return start.func(start.arg);
+}
+
+static inline int rt_thread_create(pthread_t* thread, const rt_thread_attr_t* attr, void* (*func)(void*), void* arg) {
+    // Start func(arg) with the given attributes; falls back to default scheduling if they are refused
+    pthread_attr_t pattr;
+    struct sched_param param;
+    rt_thread_start_t* start;
+    int ret;
+
+    if ((start = malloc(sizeof(*start))) == NULL) {
+        return -1;
+    }
+    start->func = func;
+    start->arg = arg;
+    start->attr = *attr;
+
+    pthread_attr_init(&pattr);
+    pthread_attr_setinheritsched(&pattr, PTHREAD_EXPLICIT_SCHED);
+    pthread_attr_setschedpolicy(&pattr, attr->policy);
+    param.sched_priority = attr->priority;
+    pthread_attr_setschedparam(&pattr, &param);
+    if (attr->stack_size > 0) {
+        pthread_attr_setstacksize(&pattr, attr->stack_size);
+    }
+
+    if ((ret = pthread_create(thread, &pattr, rt_thread_trampoline, start)) != 0) {
+        printf("[INFO] Could not start thread %s at priority %d, using default scheduling\n", attr->name, attr->priority);
+        pthread_attr_destroy(&pattr);
+        pthread_attr_init(&pattr);
+        if (attr->stack_size > 0) {
+            pthread_attr_setstacksize(&pattr, attr->stack_size);
+        }
+        ret = pthread_create(thread, &pattr, rt_thread_trampoline, start);
+    }
+    pthread_attr_destroy(&pattr);
+    if (ret != 0) {
+        free(start);
+        return -1;
+    }
+    return 0;
+}
+
+static inline int rt_mutex_init(pthread_mutex_t* mutex) {
+    // Priority-inheritance mutex, or a plain one where the protocol is not supported
+    pthread_mutexattr_t mattr;
+    int ret;
+
+    pthread_mutexattr_init(&mattr);
+    pthread_mutexattr_setprotocol(&mattr, PTHREAD_PRIO_INHERIT);
+    if ((ret = pthread_mutex_init(mutex, &mattr)) != 0) {
+        ret = pthread_mutex_init(mutex, NULL);
+    }
+    pthread_mutexattr_destroy(&mattr);
+    return ret;
+}
+
+static inline int rt_thread_policy(const char* name) {
+    if (!strcmp(name, "fifo")) return SCHED_FIFO;
+    if (!strcmp(name, "rr")) return SCHED_RR;
+    if (!strcmp(name, "other")) return SCHED_OTHER;
+    return -1;
+}
+
+static inline int rt_thread_config_load(const char* filename, rt_thread_attr_t* attrs, int count) {
+    // Override the entries of attrs named in the file. Returns the number of lines applied, -1 if there is no file.
+    FILE* file;
+    char line[256], name[64], policy[16];
+    int priority, cpu, stack_kb, i, lineno = 0, applied = 0;
+
+    if ((file = fopen(filename, "r")) == NULL) {
+        return -1;
+    }
+    while (fgets(line, sizeof(line), file)) {
+        lineno++;
+        if (line[strspn(line, " \t")] == '#' || line[strspn(line, " \t\r\n")] == '\0') continue;
+
+        if (sscanf(line, "%63s %15s %d %d %d", name, policy, &priority, &cpu, &stack_kb) != 5 || rt_thread_policy(policy) == -1) {
+            printf("[ERROR] %s:%d: expected 'name fifo|rr|other priority cpu stack_kb'\n", filename, lineno);
+            continue;
+        }
+        for (i = 0; i < count && strcmp(attrs[i].name, name); i++);
+        if (i == count) {
+            printf("[ERROR] %s:%d: no thread called %s\n", filename, lineno, name);
+            continue;
+        }
+        attrs[i].policy = rt_thread_policy(policy);
+        attrs[i].priority = priority;
+        attrs[i].cpu = cpu;
+        attrs[i].stack_size = (size_t)stack_kb * 1024;
+        applied++;
+    }
+    fclose(file);
+    return applied;
+}
+
+#endif
@@ -0,0 +1,257 @@
+// Absolute-deadline timing for periodic output loops
+//
+// Deadlines are kept on CLOCK_MONOTONIC as absolute times and advanced by
+// exactly one period each sample, so the time spent computing and writing a
+// sample never accumulates into frequency error. The period carries a 32-bit
+// binary fraction of a nanosecond, which keeps long-run rate error well below
+// 1 ppm for any sample rate.
+//
+// The thread sleeps with clock_nanosleep(TIMER_ABSTIME) until spin_ns before
+// the deadline and busy-waits only for that final window. Setting spin_ns to 0
+// never spins; setting it to the period spins all the time (the old ca2.c
+// behaviour).
+//
+// A deadline that has already passed when the loop arrives is a miss. With
+// RT_LATE_CATCHUP the following samples go out back to back until the loop is
+// on schedule again; with RT_LATE_SKIP the missed periods are dropped and the
+// caller is told how many, so it can discard the same number of samples and
+// stay in phase.
+//
+// rt_ticker_t is the alternative timer-driven source: a periodic kernel timer
+// wakes the thread exactly once per sample. On QNX the timer delivers a pulse
+// to a private channel and the thread blocks in MsgReceivePulse(), with
+// timer_getoverrun() reporting ticks that fired while it was still busy. On
+// Linux a timerfd gives the same behaviour for testing, its read() returning
+// the number of expirations. Late ticks follow the same catch-up/skip policy.
+// Note the QNX timer is quantised to the system tick (ClockPeriod(), 1 ms by
+// default), so sample periods below that need a finer ClockPeriod.
+
+#ifndef RT_TIMING_H
+#define RT_TIMING_H
+
+#include <stdint.h>
+#include <time.h>
+#include <errno.h>
+#include <stdio.h>
+#include <unistd.h>
+#if defined(__QNX__)
+    #include <sys/neutrino.h>
+    #include <sys/netmgr.h>
+#else
+    #include <sys/timerfd.h>
+#endif
+
+#define RT_NSEC_PER_SEC		1000000000LL
+#define RT_CATCHUP_MAX		100		// further behind than this many periods: resynchronise
+#define RT_PULSE_CODE_TIMER	_PULSE_CODE_MINAVAIL
+
+enum rt_late_policy {
+    RT_LATE_CATCHUP,
+    RT_LATE_SKIP
+};
+
+typedef struct {
+    int64_t next_ns;			// absolute deadline of the next sample
+    uint32_t next_frac;			// fractional nanoseconds of next_ns, 1/2^32 ns units
+    int64_t period_ns;
+    uint32_t period_frac;
+    int64_t spin_ns;			// final window before a deadline that is busy-waited
+    int policy;
+    unsigned long deadlines;	// deadlines waited for
+    unsigned long missed;		// deadlines that had already passed on arrival
+    unsigned long skipped;		// periods dropped by RT_LATE_SKIP or a resync
+} rt_deadline_t;
+
+static inline int64_t rt_now_ns(void) {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * RT_NSEC_PER_SEC + ts.tv_nsec;
+}
+
+static inline void rt_sleep_until_ns(int64_t deadline_ns) {
+    struct timespec ts;
+
+    ts.tv_sec = deadline_ns / RT_NSEC_PER_SEC;
+    ts.tv_nsec = deadline_ns % RT_NSEC_PER_SEC;
+    while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) == EINTR);
+}
+
+static inline void rt_deadline_set_rate(rt_deadline_t* dl, double rate) {
+    // Period for the given samples per second; takes effect from the next deadline
+    double period = 1e9 / rate;
+
+    dl->period_ns = (int64_t)period;
+    dl->period_frac = (uint32_t)((period - (double)dl->period_ns) * 4294967296.0);
+}
+
+static inline void rt_deadline_start(rt_deadline_t* dl, double rate, int64_t spin_ns, int policy) {
+    // First deadline is one period from now
+    rt_deadline_set_rate(dl, rate);
+    dl->spin_ns = spin_ns;
+    dl->policy = policy;
+    dl->deadlines = dl->missed = dl->skipped = 0;
+    dl->next_ns = rt_now_ns() + dl->period_ns;
+    dl->next_frac = dl->period_frac;
+}
+
+static inline void rt_deadline_advance(rt_deadline_t* dl, unsigned long periods) {
+    uint64_t frac = (uint64_t)periods * dl->period_frac + dl->next_frac;
+
+    dl->next_ns += (int64_t)periods * dl->period_ns + (int64_t)(frac >> 32);
+    dl->next_frac = (uint32_t)frac;
+}
+
+static inline unsigned long rt_deadline_wait(rt_deadline_t* dl) {
+    // Wait for the next deadline and schedule the one after. Returns the number
+    // of periods dropped, non-zero only when late under RT_LATE_SKIP or after a resync.
+    int64_t now = rt_now_ns();
+    unsigned long behind = 0;
+
+    dl->deadlines++;
+    if (now >= dl->next_ns) {
+        // Late: the sample goes out straight away
+        dl->missed++;
+        behind = (unsigned long)((now - dl->next_ns) / (dl->period_ns > 0 ? dl->period_ns : 1));
+        if (dl->policy == RT_LATE_SKIP || behind > RT_CATCHUP_MAX) {
+            dl->skipped += behind;
+            rt_deadline_advance(dl, behind);
+        }
+        else {
+            behind = 0;
+        }
+    }
+    else {
+        if (dl->next_ns - now > dl->spin_ns) {
+            rt_sleep_until_ns(dl->next_ns - dl->spin_ns);
+        }
+        while (rt_now_ns() < dl->next_ns);
+    }
+
+    rt_deadline_advance(dl, 1);
+    return behind;
+}
+
+typedef struct {
+#if defined(__QNX__)
+    int chid;					// private channel the timer pulses arrive on
+    int coid;
+    timer_t timer;
+#else
+    int fd;						// timerfd
+#endif
+    int policy;
+    unsigned long owed;			// late ticks still to be caught up without waiting
+    unsigned long ticks;		// timer expirations seen
+    unsigned long missed;		// waits that found more than one expiration
+    unsigned long skipped;		// periods dropped by RT_LATE_SKIP or a resync
+} rt_ticker_t;
+
+static inline int rt_ticker_set_rate(rt_ticker_t* tk, double rate) {
+    // (Re)arm the periodic timer, first tick one period from now. Returns -1 on error.
+    struct itimerspec its;
+    int64_t period_ns = (int64_t)(1e9 / rate + 0.5);
+
+    its.it_value.tv_sec = its.it_interval.tv_sec = period_ns / RT_NSEC_PER_SEC;
+    its.it_value.tv_nsec = its.it_interval.tv_nsec = period_ns % RT_NSEC_PER_SEC;
+#if defined(__QNX__)
+    if (timer_settime(tk->timer, 0, &its, NULL) == -1) {
+#else
+    if (timerfd_settime(tk->fd, 0, &its, NULL) == -1) {
+#endif
+        perror("timer_settime");
+        return -1;
+    }
+    return 0;
+}
+
+static inline int rt_ticker_start(rt_ticker_t* tk, double rate, int policy) {
+    // Create the timer and start it ticking at rate per second. Returns -1 on error.
+#if defined(__QNX__)
+    struct sigevent event;
+
+    if ((tk->chid = ChannelCreate(0)) == -1) {
+        perror("ChannelCreate");
+        return -1;
+    }
+    if ((tk->coid = ConnectAttach(ND_LOCAL_NODE, 0, tk->chid, _NTO_SIDE_CHANNEL, 0)) == -1) {
+        perror("ConnectAttach");
+        ChannelDestroy(tk->chid);
+        return -1;
+    }
+
+    // The pulse runs the receiving thread at its own priority
+    SIGEV_PULSE_INIT(&event, tk->coid, SIGEV_PULSE_PRIO_INHERIT, RT_PULSE_CODE_TIMER, 0);
+    if (timer_create(CLOCK_MONOTONIC, &event, &tk->timer) == -1) {
+        perror("timer_create");
+        ConnectDetach(tk->coid);
+        ChannelDestroy(tk->chid);
+        return -1;
+    }
+#else
+    if ((tk->fd = timerfd_create(CLOCK_MONOTONIC, 0)) == -1) {
+        perror("timerfd_create");
+        return -1;
+    }
+#endif
+    tk->policy = policy;
+    tk->owed = tk->ticks = tk->missed = tk->skipped = 0;
+    return rt_ticker_set_rate(tk, rate);
+}
+
+static inline unsigned long rt_ticker_wait(rt_ticker_t* tk) {
+    // Block until the next tick. Returns the number of periods dropped, as rt_deadline_wait().
+    unsigned long expirations, late;
+#if defined(__QNX__)
+    struct _pulse pulse;
+    int overrun;
+#else
+    uint64_t count;
+#endif
+
+    if (tk->owed > 0) {
+        // Catching up on ticks that fired while the loop was late
+        tk->owed--;
+        return 0;
+    }
+
+#if defined(__QNX__)
+    do {
+        if (MsgReceivePulse(tk->chid, &pulse, sizeof(pulse), NULL) == -1) {
+            return 0;
+        }
+    } while (pulse.code != RT_PULSE_CODE_TIMER);
+    overrun = timer_getoverrun(tk->timer);
+    expirations = 1 + (overrun > 0 ? overrun : 0);
+#else
+    if (read(tk->fd, &count, sizeof(count)) != sizeof(count)) {
+        return 0;
+    }
+    expirations = (unsigned long)count;
+#endif
+
+    tk->ticks += expirations;
+    late = expirations - 1;
+    if (late == 0) {
+        return 0;
+    }
+    tk->missed++;
+    if (tk->policy == RT_LATE_SKIP || late > RT_CATCHUP_MAX) {
+        tk->skipped += late;
+        return late;
+    }
+    tk->owed = late;
+    return 0;
+}
+
+static inline void rt_ticker_stop(rt_ticker_t* tk) {
+#if defined(__QNX__)
+    timer_delete(tk->timer);
+    ConnectDetach(tk->coid);
+    ChannelDestroy(tk->chid);
+#else
+    close(tk->fd);
+#endif
+}
+
+#endif
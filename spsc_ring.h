@@ -0,0 +1,89 @@
+// Lock-free single-producer / single-consumer ring of DAC frames
+//
+// The producer thread renders frames ahead of time and the output thread pops
+// them, so the time-critical loop is reduced to a couple of loads and the
+// port writes. Exactly one thread may push and exactly one thread may pop; the
+// indices run freely and are masked on access, so full and empty never need
+// a spare slot.
+
+#ifndef SPSC_RING_H
+#define SPSC_RING_H
+
+#include <stdint.h>
+#include "rt_atomic.h"
+
+#define SPSC_RING_BITS		13
+#define SPSC_RING_SIZE		(1u << SPSC_RING_BITS)
+#define SPSC_RING_MASK		(SPSC_RING_SIZE - 1)
+#define SPSC_CACHE_LINE		64
+
+// One output frame per sample period: the DAC #0 code in the low 16 bits, DAC #1 in the high 16,
+// so both channels always travel together
+typedef uint32_t dac_frame_t;
+#define DAC_FRAME(ch0, ch1)		((dac_frame_t)(ch0) | ((dac_frame_t)(ch1) << 16))
+#define DAC_FRAME_CH0(frame)	((unsigned short)((frame) & 0xFFFF))
+#define DAC_FRAME_CH1(frame)	((unsigned short)((frame) >> 16))
+
+typedef struct {
+    volatile uint32_t head;				// next slot to write, only stored by the producer
+    char pad0[SPSC_CACHE_LINE - sizeof(uint32_t)];
+    volatile uint32_t tail;				// next slot to read, only stored by the consumer
+    char pad1[SPSC_CACHE_LINE - sizeof(uint32_t)];
+    dac_frame_t slot[SPSC_RING_SIZE];
+} spsc_ring_t;
+
+static inline void spsc_ring_init(spsc_ring_t* ring) {
+    ring->head = 0;
+    ring->tail = 0;
+}
+
+static inline uint32_t spsc_ring_count(const spsc_ring_t* ring) {
+    // Frames ready to pop; exact for the consumer, a lower bound of the free space for the producer
+    return ring->head - ring->tail;
+}
+
+static inline uint32_t spsc_ring_space(const spsc_ring_t* ring) {
+    return SPSC_RING_SIZE - spsc_ring_count(ring);
+}
+
+static inline uint32_t spsc_ring_push(spsc_ring_t* ring, const dac_frame_t* frames, uint32_t n) {
+    // Producer: append up to n frames, returns how many fit
+    uint32_t head = ring->head;
+    uint32_t space = SPSC_RING_SIZE - (head - rt_load_acquire(&ring->tail));
+    uint32_t i;
+
+    if (n > space) n = space;
+    for (i = 0; i < n; i++) {
+        ring->slot[(head + i) & SPSC_RING_MASK] = frames[i];
+    }
+    rt_store_release(&ring->head, head + n);
+    return n;
+}
+
+static inline int spsc_ring_pop(spsc_ring_t* ring, dac_frame_t* frame) {
+    // Consumer: take one frame, returns 0 if the ring was empty
+    uint32_t tail = ring->tail;
+
+    if (rt_load_acquire(&ring->head) == tail) {
+        return 0;
+    }
+    *frame = ring->slot[tail & SPSC_RING_MASK];
+    rt_store_release(&ring->tail, tail + 1);
+    return 1;
+}
+
+static inline uint32_t spsc_ring_pop_block(spsc_ring_t* ring, dac_frame_t* frames, uint32_t n) {
+    // Consumer: take up to n frames, returns how many were available
+    uint32_t tail = ring->tail;
+    uint32_t count = rt_load_acquire(&ring->head) - tail;
+    uint32_t i;
+
+    if (n > count) n = count;
+    for (i = 0; i < n; i++) {
+        frames[i] = ring->slot[(tail + i) & SPSC_RING_MASK];
+    }
+    rt_store_release(&ring->tail, tail + n);
+    return n;
+}
+
+#endif
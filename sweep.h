@@ -0,0 +1,115 @@
+// Frequency chirps and amplitude ramps for the DDS output
+//
+// A sweep moves the DDS tuning word from a start to an end frequency over a
+// number of samples, linearly (a constant increment per sample) or
+// logarithmically (a constant ratio per sample, i.e. equal time per octave),
+// and ramps the amplitude linearly alongside it. Only the increment and the
+// ratio are worked out in sweep_start(); each sample then costs one add or
+// one multiply, no transcendental call.
+//
+// The sweep only ever changes the tuning word, never the phase accumulator,
+// so the output is phase continuous through the whole chirp and across the
+// jump back to the start frequency when a repeating sweep starts over. A
+// one-shot sweep holds its end frequency and amplitude once it has finished.
+
+#ifndef SWEEP_H
+#define SWEEP_H
+
+#include <stdint.h>
+#include <math.h>
+#include "dds.h"
+
+enum sweep_shape {
+    SWEEP_LINEAR,
+    SWEEP_LOG
+};
+
+typedef struct {
+    int shape;
+    int repeat;					// start over at the end instead of holding the end values
+    int active;					// 0 before the start and after a one-shot sweep ends
+    uint64_t samples;			// length of one sweep
+    uint64_t n;					// samples into the current sweep
+    unsigned long sweeps;		// sweeps completed
+    double tuning;				// current tuning word, kept in double so small steps accumulate
+    double tuning_start;
+    double tuning_end;
+    double tuning_step;			// per sample: added (linear) or multiplied by (log)
+    float amplitude;
+    float amplitude_start;
+    float amplitude_end;
+    float amplitude_step;		// added per sample
+} sweep_t;
+
+static inline int sweep_start(sweep_t* s, int shape, float f0, float f1, float a0, float a1, double seconds, double sample_rate, int repeat) {
+    // Set up and start a sweep from (f0, a0) to (f1, a1). Returns -1 if the values cannot be swept that way.
+    if (seconds <= 0.0 || f0 <= 0.0f || f1 <= 0.0f) {
+        return -1;
+    }
+    s->shape = shape;
+    s->repeat = repeat;
+    s->samples = (uint64_t)(seconds * sample_rate);
+    if (s->samples == 0) s->samples = 1;
+    s->tuning_start = dds_tuning_word(f0, sample_rate);
+    s->tuning_end = dds_tuning_word(f1, sample_rate);
+    if (shape == SWEEP_LOG) {
+        s->tuning_step = pow(s->tuning_end / s->tuning_start, 1.0 / s->samples);
+    }
+    else {
+        s->tuning_step = (s->tuning_end - s->tuning_start) / s->samples;
+    }
+    s->amplitude_start = a0;
+    s->amplitude_end = a1;
+    s->amplitude_step = (a1 - a0) / s->samples;
+
+    s->tuning = s->tuning_start;
+    s->amplitude = a0;
+    s->n = 0;
+    s->sweeps = 0;
+    s->active = 1;
+    return 0;
+}
+
+static inline void sweep_restart(sweep_t* s) {
+    // Back to the start values; the phase carries on
+    s->tuning = s->tuning_start;
+    s->amplitude = s->amplitude_start;
+    s->n = 0;
+    s->active = 1;
+}
+
+static inline float sweep_step(sweep_t* s, dds_t* dds) {
+    // Set the DDS tuning word for this sample and return its amplitude, then advance the sweep by one sample
+    float amplitude = s->amplitude;
+
+    dds->tuning = (uint32_t)(s->tuning + 0.5);
+    if (!s->active) {
+        return amplitude;
+    }
+
+    if (++s->n < s->samples) {
+        if (s->shape == SWEEP_LOG) s->tuning *= s->tuning_step;
+        else s->tuning += s->tuning_step;
+        s->amplitude += s->amplitude_step;
+    }
+    else {
+        // Land exactly on the end values rather than on the accumulated ones
+        s->sweeps++;
+        if (s->repeat) {
+            sweep_restart(s);
+        }
+        else {
+            s->tuning = s->tuning_end;
+            s->amplitude = s->amplitude_end;
+            s->active = 0;
+        }
+    }
+    return amplitude;
+}
+
+static inline double sweep_frequency(const sweep_t* s, double sample_rate) {
+    // Frequency being produced now
+    return dds_frequency((uint32_t)(s->tuning + 0.5), sample_rate);
+}
+
+#endif
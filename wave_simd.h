@@ -0,0 +1,298 @@
+// SIMD kernels for filling waveform tables
+//
+// Large tables (AWG buffers, the 100000-point tables of wave_generator.c)
+// spend their time in sinf()/exp() per point and in the float to DAC code
+// conversion. These kernels do a whole block at a time:
+//   simd_sine()     sin(2 pi t) for t = t0 + i * dt, a degree 11 polynomial
+//                   after reduction to a quarter cycle, within 1e-7 of sinf
+//   simd_cardiac()  the cardiac shape of dds.h, three Gaussians through a
+//                   Cephes-style expf (2^k times a degree 6 polynomial)
+//   simd_codes()    mean + amplitude * shape, clamped to 0-5V, as 16-bit codes,
+//                   converted in double exactly as voltage_to_dac()
+//
+// The instruction set is picked at compile time: AVX2 (8 floats) when built
+// with -mavx2, else SSE2 (4 floats, always there on x86-64 and the x86 QNX
+// targets), else plain C. Every variant runs the same arithmetic, and the
+// scalar versions are always available (simd_*_scalar) for the tail of a
+// block and for comparison. dds_init() in dds.h fills the sine and cardiac
+// tables with simd_sine() and simd_cardiac(), ca2.c its generators, and
+// wave_codes() in wave_table.h converts the tables with simd_codes().
+
+#ifndef WAVE_SIMD_H
+#define WAVE_SIMD_H
+
+#include <stdint.h>
+#include <math.h>
+#if defined(__AVX2__)
+    #include <immintrin.h>
+#elif defined(__SSE2__)
+    #include <emmintrin.h>
+#endif
+
+// sin(2 pi x) on [-0.25, 0.25]: Taylor coefficients of the odd powers up to 11
+#define SIMD_S1		6.28318530717958648f
+#define SIMD_S3		-41.3417022403997339f
+#define SIMD_S5		81.6052492760750479f
+#define SIMD_S7		-76.7058597530612453f
+#define SIMD_S9		42.0587306031477085f
+#define SIMD_S11	-15.0946425768033720f
+
+// expf: x = k ln2 + r, e^r by a polynomial (Cephes), 2^k built in the exponent field
+#define SIMD_LOG2E		1.44269504088896341f
+#define SIMD_LN2_HI		0.693359375f
+#define SIMD_LN2_LO		-2.12194440e-4f
+#define SIMD_EXP_MIN	-80.0f			// e^-80 and its multiples in the shapes stay normal floats; denormals are slow
+#define SIMD_EXP_MAX	88.3f
+#define SIMD_E0		1.9875691500e-4f
+#define SIMD_E1		1.3981999507e-3f
+#define SIMD_E2		8.3334519073e-3f
+#define SIMD_E3		4.1665795894e-2f
+#define SIMD_E4		1.6666665459e-1f
+#define SIMD_E5		5.0000001201e-1f
+
+#define SIMD_VOLTS_MAX	5.0f				// DAC full scale; codes are (volts / 5.0) * 0xFFFF in double, as voltage_to_dac()
+#define SIMD_ROUND_MAGIC	12582912.0f			// 1.5 * 2^23: adding it rounds any |x| < 2^22 to an integer
+
+// Scalar versions, the reference for the vector code
+
+static inline float simd_round_scalar(float x) {
+    // Nearest integer, as the vector conversion rounds; lrintf() is a library call without SSE4.1
+    float r = x + SIMD_ROUND_MAGIC;
+
+    return r - SIMD_ROUND_MAGIC;
+}
+
+static inline float simd_sin_cycle_scalar(float t) {
+    // sin(2 pi t)
+    float x = t - simd_round_scalar(t);			// [-0.5, 0.5]
+    float a = fabsf(x);
+    float y = (a < 0.5f - a) ? a : 0.5f - a;	// sin(pi - u) = sin(u): fold onto [0, 0.25]
+    float y2 = y * y;
+    float p = ((((SIMD_S11 * y2 + SIMD_S9) * y2 + SIMD_S7) * y2 + SIMD_S5) * y2 + SIMD_S3) * y2 + SIMD_S1;
+
+    p *= y;
+    return (x < 0.0f) ? -p : p;
+}
+
+static inline float simd_exp_scalar(float x) {
+    float k, r, p;
+    union { float f; int32_t i; } scale;
+
+    x = (x < SIMD_EXP_MIN) ? SIMD_EXP_MIN : x;
+    x = (x > SIMD_EXP_MAX) ? SIMD_EXP_MAX : x;
+    k = simd_round_scalar(x * SIMD_LOG2E);
+    r = x - k * SIMD_LN2_HI - k * SIMD_LN2_LO;
+    p = ((((SIMD_E0 * r + SIMD_E1) * r + SIMD_E2) * r + SIMD_E3) * r + SIMD_E4) * r + SIMD_E5;
+    p = p * r * r + r + 1.0f;
+    scale.i = ((int32_t)k + 127) << 23;
+    return p * scale.f;
+}
+
+static inline float simd_cardiac_point(float t) {
+    float a = t - 0.2f, b = t - 0.35f, c = t - 0.75f;
+
+    return simd_exp_scalar(-200.0f * a * a) - 0.1f * simd_exp_scalar(-50.0f * b * b) + 0.05f * simd_exp_scalar(-300.0f * c * c);
+}
+
+static inline unsigned short simd_code_scalar(float shape, float mean, float amplitude) {
+    float v = mean + amplitude * shape;
+
+    v = (v < 0.0f) ? 0.0f : v;
+    v = (v > SIMD_VOLTS_MAX) ? SIMD_VOLTS_MAX : v;
+    return (unsigned short)((v / 5.0) * 0xFFFF);
+}
+
+static inline void simd_sine_scalar(float* out, int n, float t0, float dt) {
+    int i;
+
+    for (i = 0; i < n; i++) out[i] = simd_sin_cycle_scalar(t0 + (float)i * dt);
+}
+
+static inline void simd_cardiac_scalar(float* out, int n) {
+    // One cycle over n points, t = i / n
+    int i;
+
+    for (i = 0; i < n; i++) out[i] = simd_cardiac_point((float)i / n);
+}
+
+static inline void simd_codes_scalar(unsigned short* code, const float* shape, int n, float mean, float amplitude) {
+    int i;
+
+    for (i = 0; i < n; i++) code[i] = simd_code_scalar(shape[i], mean, amplitude);
+}
+
+// Vector primitives for the instruction set in use
+
+#if defined(__AVX2__)
+    #define SIMD_ISA		"avx2"
+    #define SIMD_WIDTH		8
+    typedef __m256 simd_f;
+    typedef __m256i simd_i;
+    #define simd_set1(x)		_mm256_set1_ps(x)
+    #define simd_iota()			_mm256_setr_ps(0, 1, 2, 3, 4, 5, 6, 7)
+    #define simd_add(a, b)		_mm256_add_ps(a, b)
+    #define simd_sub(a, b)		_mm256_sub_ps(a, b)
+    #define simd_mul(a, b)		_mm256_mul_ps(a, b)
+    #define simd_div(a, b)		_mm256_div_ps(a, b)
+    #define simd_min(a, b)		_mm256_min_ps(a, b)
+    #define simd_max(a, b)		_mm256_max_ps(a, b)
+    #define simd_and(a, b)		_mm256_and_ps(a, b)
+    #define simd_andnot(a, b)	_mm256_andnot_ps(a, b)
+    #define simd_or(a, b)		_mm256_or_ps(a, b)
+    #define simd_load(p)		_mm256_loadu_ps(p)
+    #define simd_store(p, a)	_mm256_storeu_ps(p, a)
+    #define simd_round_i(a)		_mm256_cvtps_epi32(a)
+    #define simd_to_f(a)		_mm256_cvtepi32_ps(a)
+    #define simd_exp2_i(k)		_mm256_castsi256_ps(_mm256_slli_epi32(_mm256_add_epi32(k, _mm256_set1_epi32(127)), 23))
+
+    static inline simd_i simd_volts_to_codes(simd_f v) {
+        // (v / 5.0) * 0xFFFF truncated, in double like voltage_to_dac(): four lanes at a time
+        __m256d lo = _mm256_cvtps_pd(_mm256_castps256_ps128(v)), hi = _mm256_cvtps_pd(_mm256_extractf128_ps(v, 1));
+
+        lo = _mm256_mul_pd(_mm256_div_pd(lo, _mm256_set1_pd(5.0)), _mm256_set1_pd(0xFFFF));
+        hi = _mm256_mul_pd(_mm256_div_pd(hi, _mm256_set1_pd(5.0)), _mm256_set1_pd(0xFFFF));
+        return _mm256_inserti128_si256(_mm256_castsi128_si256(_mm256_cvttpd_epi32(lo)), _mm256_cvttpd_epi32(hi), 1);
+    }
+
+    static inline void simd_store_codes(unsigned short* code, simd_i v) {
+        // Eight 0-65535 ints to unsigned shorts
+        __m128i lo = _mm256_castsi256_si128(v), hi = _mm256_extracti128_si256(v, 1);
+
+        _mm_storeu_si128((__m128i*)code, _mm_packus_epi32(lo, hi));
+    }
+#elif defined(__SSE2__)
+    #define SIMD_ISA		"sse2"
+    #define SIMD_WIDTH		4
+    typedef __m128 simd_f;
+    typedef __m128i simd_i;
+    #define simd_set1(x)		_mm_set1_ps(x)
+    #define simd_iota()			_mm_setr_ps(0, 1, 2, 3)
+    #define simd_add(a, b)		_mm_add_ps(a, b)
+    #define simd_sub(a, b)		_mm_sub_ps(a, b)
+    #define simd_mul(a, b)		_mm_mul_ps(a, b)
+    #define simd_div(a, b)		_mm_div_ps(a, b)
+    #define simd_min(a, b)		_mm_min_ps(a, b)
+    #define simd_max(a, b)		_mm_max_ps(a, b)
+    #define simd_and(a, b)		_mm_and_ps(a, b)
+    #define simd_andnot(a, b)	_mm_andnot_ps(a, b)
+    #define simd_or(a, b)		_mm_or_ps(a, b)
+    #define simd_load(p)		_mm_loadu_ps(p)
+    #define simd_store(p, a)	_mm_storeu_ps(p, a)
+    #define simd_round_i(a)		_mm_cvtps_epi32(a)
+    #define simd_to_f(a)		_mm_cvtepi32_ps(a)
+    #define simd_exp2_i(k)		_mm_castsi128_ps(_mm_slli_epi32(_mm_add_epi32(k, _mm_set1_epi32(127)), 23))
+
+    static inline simd_i simd_volts_to_codes(simd_f v) {
+        // (v / 5.0) * 0xFFFF truncated, in double like voltage_to_dac(): two lanes at a time
+        __m128d lo = _mm_cvtps_pd(v), hi = _mm_cvtps_pd(_mm_movehl_ps(v, v));
+
+        lo = _mm_mul_pd(_mm_div_pd(lo, _mm_set1_pd(5.0)), _mm_set1_pd(0xFFFF));
+        hi = _mm_mul_pd(_mm_div_pd(hi, _mm_set1_pd(5.0)), _mm_set1_pd(0xFFFF));
+        return _mm_unpacklo_epi64(_mm_cvttpd_epi32(lo), _mm_cvttpd_epi32(hi));
+    }
+
+    static inline void simd_store_codes(unsigned short* code, simd_i v) {
+        // Four 0-65535 ints to unsigned shorts. SSE2 only packs with signed saturation: shift into range and back.
+        __m128i s = _mm_sub_epi32(v, _mm_set1_epi32(0x8000));
+
+        s = _mm_xor_si128(_mm_packs_epi32(s, s), _mm_set1_epi16((short)0x8000));
+        _mm_storel_epi64((__m128i*)code, s);
+    }
+#else
+    #define SIMD_ISA		"scalar"
+    #define SIMD_WIDTH		1
+#endif
+
+#if SIMD_WIDTH > 1
+
+static inline simd_f simd_sin_cycle(simd_f t) {
+    // sin(2 pi t), as simd_sin_cycle_scalar()
+    simd_f sign_mask = simd_set1(-0.0f);
+    simd_f x = simd_sub(t, simd_to_f(simd_round_i(t)));
+    simd_f sign = simd_and(x, sign_mask);
+    simd_f a = simd_andnot(sign_mask, x);
+    simd_f y = simd_min(a, simd_sub(simd_set1(0.5f), a));
+    simd_f y2 = simd_mul(y, y);
+    simd_f p = simd_set1(SIMD_S11);
+
+    p = simd_add(simd_mul(p, y2), simd_set1(SIMD_S9));
+    p = simd_add(simd_mul(p, y2), simd_set1(SIMD_S7));
+    p = simd_add(simd_mul(p, y2), simd_set1(SIMD_S5));
+    p = simd_add(simd_mul(p, y2), simd_set1(SIMD_S3));
+    p = simd_add(simd_mul(p, y2), simd_set1(SIMD_S1));
+    return simd_or(simd_mul(p, y), sign);
+}
+
+static inline simd_f simd_exp(simd_f x) {
+    // e^x, as simd_exp_scalar()
+    simd_f k, r, p;
+    simd_i ki;
+
+    x = simd_min(simd_max(x, simd_set1(SIMD_EXP_MIN)), simd_set1(SIMD_EXP_MAX));
+    ki = simd_round_i(simd_mul(x, simd_set1(SIMD_LOG2E)));
+    k = simd_to_f(ki);
+    r = simd_sub(simd_sub(x, simd_mul(k, simd_set1(SIMD_LN2_HI))), simd_mul(k, simd_set1(SIMD_LN2_LO)));
+    p = simd_set1(SIMD_E0);
+    p = simd_add(simd_mul(p, r), simd_set1(SIMD_E1));
+    p = simd_add(simd_mul(p, r), simd_set1(SIMD_E2));
+    p = simd_add(simd_mul(p, r), simd_set1(SIMD_E3));
+    p = simd_add(simd_mul(p, r), simd_set1(SIMD_E4));
+    p = simd_add(simd_mul(p, r), simd_set1(SIMD_E5));
+    p = simd_add(simd_add(simd_mul(simd_mul(p, r), r), r), simd_set1(1.0f));
+    return simd_mul(p, simd_exp2_i(ki));
+}
+
+static inline simd_f simd_gauss(simd_f t, float centre, float width) {
+    // e^(-width (t - centre)^2)
+    simd_f d = simd_sub(t, simd_set1(centre));
+
+    return simd_exp(simd_mul(simd_set1(-width), simd_mul(d, d)));
+}
+
+#endif
+
+static inline void simd_sine(float* out, int n, float t0, float dt) {
+    // out[i] = sin(2 pi (t0 + i dt))
+    int i = 0;
+#if SIMD_WIDTH > 1
+    simd_f step = simd_mul(simd_iota(), simd_set1(dt));
+
+    for (; i + SIMD_WIDTH <= n; i += SIMD_WIDTH) {
+        simd_store(out + i, simd_sin_cycle(simd_add(simd_set1(t0 + (float)i * dt), step)));
+    }
+#endif
+    simd_sine_scalar(out + i, n - i, t0 + (float)i * dt, dt);
+}
+
+static inline void simd_cardiac(float* out, int n) {
+    // One cycle of the cardiac shape over n points, t = i / n
+    int i = 0;
+#if SIMD_WIDTH > 1
+    simd_f t, v;
+
+    for (; i + SIMD_WIDTH <= n; i += SIMD_WIDTH) {
+        t = simd_div(simd_add(simd_set1((float)i), simd_iota()), simd_set1((float)n));
+        v = simd_sub(simd_gauss(t, 0.2f, 200.0f), simd_mul(simd_set1(0.1f), simd_gauss(t, 0.35f, 50.0f)));
+        v = simd_add(v, simd_mul(simd_set1(0.05f), simd_gauss(t, 0.75f, 300.0f)));
+        simd_store(out + i, v);
+    }
+#endif
+    for (; i < n; i++) out[i] = simd_cardiac_point((float)i / n);
+}
+
+static inline void simd_codes(unsigned short* code, const float* shape, int n, float mean, float amplitude) {
+    // code[i] = voltage_to_dac(mean + amplitude * shape[i])
+    int i = 0;
+#if SIMD_WIDTH > 1
+    simd_f v;
+
+    for (; i + SIMD_WIDTH <= n; i += SIMD_WIDTH) {
+        v = simd_add(simd_set1(mean), simd_mul(simd_set1(amplitude), simd_load(shape + i)));
+        v = simd_min(simd_max(v, simd_set1(0.0f)), simd_set1(SIMD_VOLTS_MAX));
+        simd_store_codes(code + i, simd_volts_to_codes(v));
+    }
+#endif
+    simd_codes_scalar(code + i, shape + i, n - i, mean, amplitude);
+}
+
+#endif
@@ -0,0 +1,108 @@
+// Double-buffered DAC code tables for the DDS output loop
+//
+// A table holds one cycle of ready-to-write DAC codes for the current waveform
+// type, amplitude and mean, plus the DDS tuning word for the frequency. Control
+// threads render the next table into the back buffer and publish it with one
+// atomic pointer store; the output loop picks it up at the end of a cycle, so a
+// parameter change costs the loop one load per cycle and never cuts a cycle short.
+//
+// Buffer ownership: the output loop owns the table it is playing, the writer
+// owns the other one. Publishing hands the back buffer over through 'pending';
+// a writer that publishes again before the loop has taken it simply reclaims
+// it with an exchange and renders over it, so writers never wait on the loop.
+
+#ifndef WAVE_TABLE_H
+#define WAVE_TABLE_H
+
+#include <pthread.h>
+#include <stddef.h>
+#include "dds.h"
+#include "wave_simd.h"
+#include "rt_atomic.h"
+#include "rt_thread.h"
+
+typedef struct {
+    unsigned short code[DDS_TABLE_SIZE];	// one cycle of DAC codes
+    uint32_t tuning;						// DDS phase increment per sample
+    int type;
+    float amplitude;
+    float frequency;
+    float mean;
+} wave_table_t;
+
+typedef struct {
+    wave_table_t buf[2];
+    wave_table_t* pending;		// published but not yet playing, NULL if none
+    wave_table_t* published;	// last table handed to the loop (writer side)
+    double sample_rate;			// output samples per second the tuning words are for
+    pthread_mutex_t lock;		// serialises writers only, never taken by the loop
+} wave_tables_t;
+
+static inline unsigned short voltage_to_dac(float voltage) {
+    // Clamp a voltage to the 0-5V unipolar range and convert it to a DAC code
+    if (voltage < 0.0) voltage = 0.0;
+    if (voltage > 5.0) voltage = 5.0;
+    return (unsigned short)((voltage / 5.0) * 0xFFFF);
+}
+
+// All-zero shape, for types that are not played from a table: they render as the mean
+static const float wave_flat[DDS_TABLE_SIZE];
+
+static inline void wave_codes(unsigned short* code, const float* shape, int n, float mean, float amplitude) {
+    // voltage_to_dac(mean + amplitude * shape) for a whole table, a SIMD block at a time
+    simd_codes(code, shape, n, mean, amplitude);
+}
+
+static inline void wave_table_render(wave_table_t* table, double sample_rate, int type, float amplitude, float frequency, float mean) {
+    // Render one cycle of codes. Runs in the writer's thread, off the output loop.
+    // Types past the DDS shapes (arbitrary playback) are not played from the table and hold the mean.
+    wave_codes(table->code, (type >= 0 && type < DDS_WAVE_COUNT) ? dds_shape[type] : wave_flat, DDS_TABLE_SIZE, mean, amplitude);
+    table->tuning = dds_tuning_word(frequency, sample_rate);
+    table->type = type;
+    table->amplitude = amplitude;
+    table->frequency = frequency;
+    table->mean = mean;
+}
+
+static inline wave_table_t* wave_tables_init(wave_tables_t* tables, double sample_rate, int type, float amplitude, float frequency, float mean) {
+    // Render the first table and return it; the output loop starts playing it directly
+    tables->sample_rate = sample_rate;
+    tables->pending = NULL;
+    tables->published = &tables->buf[0];
+    rt_mutex_init(&tables->lock);		// writers include the UI threads
+    wave_table_render(&tables->buf[0], sample_rate, type, amplitude, frequency, mean);
+    return &tables->buf[0];
+}
+
+static inline void wave_tables_publish(wave_tables_t* tables, int type, float amplitude, float frequency, float mean) {
+    // Render the new settings into the back buffer and hand it to the output loop
+    wave_table_t* back;
+
+    pthread_mutex_lock(&tables->lock);
+
+    // Still pending: the loop has not seen it, take it back and render over it.
+    // Otherwise the loop has switched to it and released the other buffer.
+    back = rt_exchange(&tables->pending, (wave_table_t*)NULL);
+    if (back == NULL) {
+        back = (tables->published == &tables->buf[0]) ? &tables->buf[1] : &tables->buf[0];
+    }
+
+    wave_table_render(back, tables->sample_rate, type, amplitude, frequency, mean);
+    tables->published = back;
+    rt_store_release(&tables->pending, back);
+
+    pthread_mutex_unlock(&tables->lock);
+}
+
+static inline wave_table_t* wave_tables_swap(wave_tables_t* tables, wave_table_t* current) {
+    // Output loop side, called at a cycle boundary: the new table if one was published, else current
+    wave_table_t* next;
+
+    if (*(wave_table_t* volatile*)&tables->pending == NULL) {
+        return current;
+    }
+    next = rt_exchange(&tables->pending, (wave_table_t*)NULL);
+    return next ? next : current;
+}
+
+#endif